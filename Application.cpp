@@ -65,6 +65,7 @@ namespace Apostol {
             CLogFile *pLogFile;
 
             Log()->Clear();
+            Log()->UpdateTargets();
 #ifdef _DEBUG
             Log()->DebugLevel(APP_LOG_DEBUG_ALL & ~APP_LOG_DEBUG_EVENT);
 #else
@@ -100,6 +101,9 @@ namespace Apostol {
                 pLogFile->LogType(ltDebug);
             }
 #endif
+            for (int i = 0; i <= ltDebug; ++i) {
+                Log()->SetLimit((CLogType) i, Config()->LogLimit((CLogType) i), Config()->LogLimitInterval((CLogType) i));
+            }
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -236,6 +240,9 @@ namespace Apostol {
             MkDir(Prefix + _T("oauth2/"));
             MkDir(Config()->ConfPrefix());
             MkDir(Config()->CachePrefix());
+#ifdef WITH_ZLIB
+            MkDir(Config()->CachePrefix() + _T("gzip/"));
+#endif
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -628,6 +635,8 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         void CProcessSingle::BeforeRun() {
+            CCachedTime::Update();
+
             Application()->Header(Application()->Name() + ": single process " + Application()->CmdLine());
 
             Log()->Notice(MSG_PROCESS_START, GetProcessName(), Application()->Header().c_str());
@@ -651,6 +660,14 @@ namespace Apostol {
 #endif
             Initialization();
 
+            Scoreboard().Create(1);
+            Scoreboard().Attach(GetProcessName());
+#ifndef APOSTOL_SERVER_TYPE_TCP
+            if (Config()->Metrics()) {
+                Metrics().Create(1);
+                Metrics().Attach(*this);
+            }
+#endif
             SetTimerInterval(1000);
         }
         //--------------------------------------------------------------------------------------------------------------
@@ -668,6 +685,7 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         void CProcessSingle::DoExit() {
+            Log()->FlushAccess();
             Log()->Debug(APP_LOG_DEBUG_EVENT, _T("exiting single process"));
         }
         //--------------------------------------------------------------------------------------------------------------
@@ -684,6 +702,18 @@ namespace Apostol {
                     Log()->Error(APP_LOG_ERR, 0, "%s", e.what());
                 }
 
+                CCachedTime::Update();
+
+#ifdef WITH_POSTGRESQL
+                // Statements queued during this cycle go out as one batch per configuration
+                FlushSQL();
+#endif
+
+                UpdateScoreboard();
+
+                // One write per event loop cycle for the buffered access log
+                Log()->FlushAccess();
+
                 if (sig_reconfigure) {
                     sig_reconfigure = 0;
                     Log()->Debug(APP_LOG_DEBUG_EVENT, _T("reconfiguring"));
@@ -694,8 +724,16 @@ namespace Apostol {
                 if (sig_reopen) {
                     sig_reopen = 0;
                     Log()->Debug(APP_LOG_DEBUG_EVENT, _T("reopening logs"));
+                    Log()->Reopen();
                     Log()->RedirectStdErr();
                 }
+
+                if (sig_status) {
+                    sig_status = 0;
+                    Scoreboard().Dump();
+                }
+
+                Log()->Rotate(Config()->LogRotateSize(), Config()->LogRotateCount());
             }
 
             DoExit();
@@ -710,16 +748,34 @@ namespace Apostol {
         CProcessMaster::CProcessMaster(CCustomProcess *AParent, CApplication *AApplication) :
                 inherited(AParent, AApplication, ptMaster, "master"), CModuleProcess() {
 
-            InitializeServer(AApplication->Title());
+            if (Config()->ReusePort()) {
+                // Each worker binds its own SO_REUSEPORT socket, the master must not hold a listening socket
+                Server().ServerName() = AApplication->Title();
+            } else {
+                InitializeServer(AApplication->Title());
+            }
+
             InitializeServerHandlers();
         }
         //--------------------------------------------------------------------------------------------------------------
 
         void CProcessMaster::BeforeRun() {
+            CCachedTime::Update();
+
             Application()->Header(Application()->Name() + ": master process " + Application()->CmdLine());
 
             Log()->Notice(MSG_PROCESS_START, GetProcessName(), Application()->Header().c_str());
 
+            // Log files the master creates on reopen and rotation belong to the user the workers run as
+            if (::geteuid() == 0) {
+                const auto pw = ::getpwnam(Config()->User().c_str());
+                const auto gr = Config()->Group().IsEmpty() ? nullptr : ::getgrnam(Config()->Group().c_str());
+
+                if (pw != nullptr) {
+                    Log()->Owner(pw->pw_uid, gr != nullptr ? gr->gr_gid : pw->pw_gid);
+                }
+            }
+
             InitSignals();
         }
         //--------------------------------------------------------------------------------------------------------------
@@ -831,6 +887,8 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         void CProcessMaster::DoExit() {
+            Log()->FlushRing();
+
             DeletePidFile();
 
             Log()->Debug(APP_LOG_DEBUG_EVENT, _T("exiting master process"));
@@ -904,10 +962,43 @@ namespace Apostol {
             struct itimerval itv = {};
             uint_t delay;
 
+            // The only ITIMER_REAL is armed for the nearest of the next tick and the termination deadline,
+            // so a SIGALRM just means "something is due" and the clock tells what
+            uint64_t tick_deadline = 0;
+            uint64_t delay_deadline = 0;
+
+            auto clock_ms = []() {
+                struct timespec ts = {};
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+            };
+
             CreatePidFile();
 
             SigProcMask(SIG_BLOCK, &set);
 
+            if (Config()->LogRing()) {
+                // Room for a full set of workers during reconfiguration plus helpers
+                Log()->Ring().Create((int) Config()->Workers() * 2 + 4, Config()->LogRingSize());
+            }
+
+            // One slot per child process, room for a full set of workers during reconfiguration
+            Scoreboard().Create((int) Config()->Workers() * 2 + 4);
+#ifndef APOSTOL_SERVER_TYPE_TCP
+            if (Config()->Metrics()) {
+                // Workers and helpers read each other's slots to serve the exposition
+                Metrics().Create((int) Config()->Workers() * 2 + 4);
+            }
+#endif
+
+            // Periodic wake-ups to drain the log ring and to check the log file sizes
+            const bool ticking = Config()->LogRing() || Config()->LogRotateSize() != 0;
+            const uint64_t interval = Config()->LogRing() ? LOG_RING_INTERVAL : 1000;
+
+            if (ticking) {
+                tick_deadline = clock_ms() + interval;
+            }
+
             StartProcesses(PROCESS_RESPAWN);
 
             NewBinary(0);
@@ -934,19 +1025,31 @@ namespace Apostol {
             bool live = true;
             while (!(live && (sig_terminate || sig_quit))) {
 
+                auto now = clock_ms();
+
                 if (delay) {
-                    if (sig_sigalrm) {
+                    if (delay_deadline != 0 && now >= delay_deadline) {
                         sigio = 0;
                         delay *= 2;
-                        sig_sigalrm = 0;
+                        delay_deadline = 0;
                     }
 
-                    Log()->Debug(APP_LOG_DEBUG_EVENT, _T("termination cycle: %M"), delay);
+                    if (delay_deadline == 0) {
+                        Log()->Debug(APP_LOG_DEBUG_EVENT, _T("termination cycle: %M"), delay);
+                        delay_deadline = now + delay;
+                    }
+                }
+
+                const auto deadline = tick_deadline == 0 ? delay_deadline : delay_deadline == 0 ? tick_deadline :
+                        Min(tick_deadline, delay_deadline);
+
+                if (deadline != 0) {
+                    const auto timeout = deadline > now ? deadline - now : 1;
 
                     itv.it_interval.tv_sec = 0;
                     itv.it_interval.tv_usec = 0;
-                    itv.it_value.tv_sec = delay / 1000;
-                    itv.it_value.tv_usec = (delay % 1000 ) * 1000;
+                    itv.it_value.tv_sec = (time_t) (timeout / 1000);
+                    itv.it_value.tv_usec = (suseconds_t) ((timeout % 1000) * 1000);
 
                     if (setitimer(ITIMER_REAL, &itv, nullptr) == -1) {
                         Log()->Error(APP_LOG_ALERT, errno, _T("setitimer() failed"));
@@ -957,8 +1060,27 @@ namespace Apostol {
 
                 sigsuspend(&set);
 
+                CCachedTime::Update();
+
+                sig_sigalrm = 0;
+                now = clock_ms();
+
                 Log()->Debug(APP_LOG_DEBUG_EVENT, _T("wake up, sigio %i"), sigio);
 
+                // Every wake-up drains, the tick only guarantees there is one at least each interval
+                if (ticking) {
+                    if (now >= tick_deadline) {
+                        tick_deadline = now + interval;
+                    }
+
+                    Log()->FlushRing();
+                    Log()->FlushSuppressed();
+
+                    if (Log()->Rotate(Config()->LogRotateSize(), Config()->LogRotateCount())) {
+                        SignalToProcesses(signal_value(SIG_REOPEN_SIGNAL));
+                    }
+                }
+
                 if (sig_reap) {
                     sig_reap = 0;
                     Log()->Debug(APP_LOG_DEBUG_EVENT, _T("reap children"));
@@ -1027,11 +1149,17 @@ namespace Apostol {
 
                     Log()->Debug(APP_LOG_DEBUG_EVENT, _T("reopening logs"));
 
-                    CApplication::CreateLogFiles();
+                    Log()->FlushRing();
+                    Log()->Reopen();
 
                     SignalToProcesses(signal_value(SIG_REOPEN_SIGNAL));
                 }
 
+                if (sig_status) {
+                    sig_status = 0;
+                    Scoreboard().Dump();
+                }
+
                 if (sig_change_binary) {
                     sig_change_binary = 0;
                     Log()->Debug(APP_LOG_DEBUG_EVENT, _T("changing binary"));
@@ -1126,7 +1254,7 @@ namespace Apostol {
         void CProcessWorker::Init() {
             const auto pParent = dynamic_cast<CServerProcess *>(Parent());
 
-            if (pParent != nullptr) {
+            if (pParent != nullptr && !Config()->ReusePort()) {
                 Server() = pParent->Server();
 #ifdef WITH_STREAM_SERVER
                 StreamServer() = pParent->StreamServer();
@@ -1134,6 +1262,7 @@ namespace Apostol {
                 Log()->Debug(APP_LOG_DEBUG_EVENT, _T("worker process: server assigned by parent"));
             } else {
                 InitializeServer(Application()->Title());
+                Log()->Debug(APP_LOG_DEBUG_EVENT, _T("worker process: server initialized"));
             }
 
             InitializeServerHandlers();
@@ -1144,10 +1273,14 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         void CProcessWorker::BeforeRun() {
+            CCachedTime::Update();
+
             Application()->Header(Application()->Name() + ": worker process (" + ModulesNames() + ")");
 
             Log()->Notice(MSG_PROCESS_START, GetProcessName(), Application()->Header().c_str());
 
+            Log()->Ring().Attach();
+
             InitSignals();
 
             SetLimitNoFile(Config()->LimitNoFile());
@@ -1160,6 +1293,10 @@ namespace Apostol {
 #endif
             Initialization();
 
+            Scoreboard().Attach(GetProcessName());
+#ifndef APOSTOL_SERVER_TYPE_TCP
+            Metrics().Attach(*this);
+#endif
             SetUser(Config()->User(), Config()->Group());
 
             SigProcMask(SIG_UNBLOCK);
@@ -1182,6 +1319,7 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         void CProcessWorker::DoExit() {
+            Log()->FlushAccess();
             Log()->Debug(APP_LOG_DEBUG_EVENT, _T("exiting worker process"));
         }
         //--------------------------------------------------------------------------------------------------------------
@@ -1197,6 +1335,18 @@ namespace Apostol {
                     Log()->Error(APP_LOG_ERR, 0, "%s", e.what());
                 }
 
+                CCachedTime::Update();
+
+#ifdef WITH_POSTGRESQL
+                // Statements queued during this cycle go out as one batch per configuration
+                FlushSQL();
+#endif
+
+                UpdateScoreboard();
+
+                // One write per event loop cycle for the buffered access log
+                Log()->FlushAccess();
+
                 if (sig_terminate || sig_quit) {
                     if (sig_quit) {
                         sig_quit = 0;
@@ -1213,8 +1363,8 @@ namespace Apostol {
 
                 if (sig_reopen) {
                     sig_reopen = 0;
-                    //Log()->Debug(APP_LOG_DEBUG_EVENT, _T("reopening logs"));
-                    //ReopenFiles(-1);
+                    Log()->Debug(APP_LOG_DEBUG_EVENT, _T("reopening logs"));
+                    Log()->Reopen();
                 }
             }
 
@@ -1254,15 +1404,20 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         void CProcessHelper::DoExit() {
+            Log()->FlushAccess();
             Log()->Debug(APP_LOG_DEBUG_EVENT, _T("exiting helper process"));
         }
         //--------------------------------------------------------------------------------------------------------------
 
         void CProcessHelper::BeforeRun() {
+            CCachedTime::Update();
+
             Application()->Header(Application()->Name() + ": helper process (" + CModuleProcess::ModulesNames() + ")");
 
             Log()->Notice(MSG_PROCESS_START, GetProcessName(), Application()->Header().c_str());
 
+            Log()->Ring().Attach();
+
             SetLimitNoFile(Config()->LimitNoFile());
 
             Init();
@@ -1272,6 +1427,10 @@ namespace Apostol {
 #endif
             Initialization();
 
+            Scoreboard().Attach(GetProcessName());
+#ifndef APOSTOL_SERVER_TYPE_TCP
+            Metrics().Attach(*this);
+#endif
             SetUser(Config()->User(), Config()->Group());
 
             SigProcMask(SIG_UNBLOCK);
@@ -1303,6 +1462,18 @@ namespace Apostol {
                     Log()->Error(APP_LOG_ERR, 0, "%s", E.what());
                 }
 
+                CCachedTime::Update();
+
+#ifdef WITH_POSTGRESQL
+                // Statements queued during this cycle go out as one batch per configuration
+                FlushSQL();
+#endif
+
+                UpdateScoreboard();
+
+                // One write per event loop cycle for the buffered access log
+                Log()->FlushAccess();
+
                 if (sig_terminate || sig_quit) {
                     if (sig_quit) {
                         sig_quit = 0;
@@ -1319,8 +1490,8 @@ namespace Apostol {
 
                 if (sig_reopen) {
                     sig_reopen = 0;
-                    //Log()->Debug(APP_LOG_DEBUG_EVENT, _T("reopening logs"));
-                    //ReopenFiles(-1);
+                    Log()->Debug(APP_LOG_DEBUG_EVENT, _T("reopening logs"));
+                    Log()->Reopen();
                 }
             }
 
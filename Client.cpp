@@ -226,6 +226,8 @@ namespace Apostol {
             const auto pTimer = dynamic_cast<CEPollTimer *> (AHandler->Binding());
             pTimer->Read(&exp, sizeof(uint64_t));
 
+            CCachedTime::Update();
+
             Heartbeat(AHandler->TimeStamp());
         }
         //--------------------------------------------------------------------------------------------------------------
@@ -389,6 +391,8 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         bool CCustomWebSocketClient::DoExecute(CTCPConnection *AConnection) {
+            CCachedTime::Update();
+
             const auto pConnection = dynamic_cast<CHTTPClientConnection *> (AConnection);
             if (pConnection->Protocol() == pWebSocket) {
                 DoWebSocket(pConnection);
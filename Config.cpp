@@ -181,11 +181,46 @@ namespace Apostol {
             m_fHelper = false;
             m_fDaemon = false;
 
+            m_fReusePort = false;
+
             m_fPostgresConnect = false;
             m_fPostgresNotice = false;
 
             m_nPostgresPollMin = 5;
             m_nPostgresPollMax = 10;
+
+            m_fPostgresBatch = false;
+            m_nPostgresBatchSize = 32;
+
+            m_nFileCacheSize = 4096;
+
+            m_nMemoryCacheSize = 16 * 1024 * 1024;
+            m_nMemoryCacheFile = 64 * 1024;
+
+            m_nQueryCacheSize = 8 * 1024 * 1024;
+            m_nQueryCacheTTL = 60;
+
+            m_fLogRing = false;
+            m_nLogRingSize = 1024 * 1024;
+
+            m_nLogRotateSize = 0;
+            m_nLogRotateCount = 5;
+
+            for (auto &Limit : m_nLogLimit) {
+                Limit = 0;
+            }
+
+            m_nLogLimitInterval = 10;
+
+            for (auto &Interval : m_nLogLimitIntervals) {
+                Interval = 0;
+            }
+
+            m_nAccessSample = 1;
+            m_nAccessSlow = 1000;
+
+            m_fMetrics = false;
+            m_fStatus = false;
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -212,6 +247,24 @@ namespace Apostol {
         }
         //--------------------------------------------------------------------------------------------------------------
 
+        void CConfig::SetMetricsHost(LPCTSTR AValue) {
+            if (m_sMetricsHost != AValue) {
+                if (AValue != nullptr) {
+                    m_sMetricsHost = AValue;
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CConfig::SetStatusHost(LPCTSTR AValue) {
+            if (m_sStatusHost != AValue) {
+                if (AValue != nullptr) {
+                    m_sStatusHost = AValue;
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
         void CConfig::SetListen(LPCTSTR AValue) {
             if (m_sListen != AValue) {
                 if (AValue != nullptr) {
@@ -430,16 +483,53 @@ namespace Apostol {
             m_fHelper = false;
             m_fDaemon = true;
 
+            m_fReusePort = false;
+
             m_fPostgresConnect = false;
             m_fPostgresNotice = false;
 
             m_nPostgresPollMin = 5;
             m_nPostgresPollMax = 10;
 
+            m_fPostgresBatch = false;
+            m_nPostgresBatchSize = 32;
+
+            m_nFileCacheSize = 4096;
+
+            m_nMemoryCacheSize = 16 * 1024 * 1024;
+            m_nMemoryCacheFile = 64 * 1024;
+
+            m_nQueryCacheSize = 8 * 1024 * 1024;
+            m_nQueryCacheTTL = 60;
+
+            m_fLogRing = false;
+            m_nLogRingSize = 1024 * 1024;
+
+            m_nLogRotateSize = 0;
+            m_nLogRotateCount = 5;
+
+            for (auto &Limit : m_nLogLimit) {
+                Limit = 0;
+            }
+
+            m_nLogLimitInterval = 10;
+
+            for (auto &Interval : m_nLogLimitIntervals) {
+                Interval = 0;
+            }
+
+            m_nAccessSample = 1;
+            m_nAccessSlow = 1000;
+
+            m_fMetrics = false;
+            m_fStatus = false;
+
             SetUser(m_sUser.empty() ? APP_DEFAULT_USER : m_sUser.c_str());
             SetGroup(m_sGroup.empty() ? APP_DEFAULT_GROUP : m_sGroup.c_str());
 
             SetListen(m_sListen.empty() ? APP_DEFAULT_LISTEN : m_sListen.c_str());
+            SetMetricsHost(m_sMetricsHost.empty() ? _T("localhost") : m_sMetricsHost.c_str());
+            SetStatusHost(m_sStatusHost.empty() ? _T("localhost") : m_sStatusHost.c_str());
 
             SetPrefix(m_sPrefix.empty() ? APP_PREFIX : m_sPrefix.c_str());
             SetConfPrefix(m_sConfPrefix.empty() ? APP_CONF_PREFIX : m_sConfPrefix.c_str());
@@ -559,6 +649,7 @@ namespace Apostol {
             Add(new CConfigCommand(_T("server"), _T("listen"), m_sListen.c_str(), [this](const auto & AValue) { SetListen(AValue); }));
             Add(new CConfigCommand(_T("server"), _T("port"), &m_nPort));
             Add(new CConfigCommand(_T("server"), _T("timeout"), &m_nTimeOut));
+            Add(new CConfigCommand(_T("server"), _T("reuseport"), &m_fReusePort));
             Add(new CConfigCommand(_T("server"), _T("root"), m_sDocRoot.c_str(), [this](const auto & AValue) { SetDocRoot(AValue); }));
 
             Add(new CConfigCommand(_T("cache"), _T("prefix"), m_sCachePrefix.c_str(), [this](const auto & AValue) { SetCachePrefix(AValue); }));
@@ -574,6 +665,39 @@ namespace Apostol {
 
             Add(new CConfigCommand(_T("postgres/poll"), _T("min"), &m_nPostgresPollMin));
             Add(new CConfigCommand(_T("postgres/poll"), _T("max"), &m_nPostgresPollMax));
+
+            Add(new CConfigCommand(_T("postgres/batch"), _T("enable"), &m_fPostgresBatch));
+            Add(new CConfigCommand(_T("postgres/batch"), _T("size"), &m_nPostgresBatchSize));
+
+            Add(new CConfigCommand(_T("cache"), _T("files"), &m_nFileCacheSize));
+            Add(new CConfigCommand(_T("cache"), _T("memory"), &m_nMemoryCacheSize));
+            Add(new CConfigCommand(_T("cache"), _T("memory_max_file"), &m_nMemoryCacheFile));
+            Add(new CConfigCommand(_T("cache"), _T("query"), &m_nQueryCacheSize));
+            Add(new CConfigCommand(_T("cache"), _T("query_ttl"), &m_nQueryCacheTTL));
+
+            Add(new CConfigCommand(_T("log/ring"), _T("enable"), &m_fLogRing));
+            Add(new CConfigCommand(_T("log/ring"), _T("size"), &m_nLogRingSize));
+
+            Add(new CConfigCommand(_T("log/rotate"), _T("size"), &m_nLogRotateSize));
+            Add(new CConfigCommand(_T("log/rotate"), _T("count"), &m_nLogRotateCount));
+
+            Add(new CConfigCommand(_T("log/limit"), _T("error"), &m_nLogLimit[ltError]));
+            Add(new CConfigCommand(_T("log/limit"), _T("postgres"), &m_nLogLimit[ltPostgres]));
+            Add(new CConfigCommand(_T("log/limit"), _T("stream"), &m_nLogLimit[ltStream]));
+            Add(new CConfigCommand(_T("log/limit"), _T("debug"), &m_nLogLimit[ltDebug]));
+            Add(new CConfigCommand(_T("log/limit"), _T("interval"), &m_nLogLimitInterval));
+            Add(new CConfigCommand(_T("log/limit/interval"), _T("error"), &m_nLogLimitIntervals[ltError]));
+            Add(new CConfigCommand(_T("log/limit/interval"), _T("postgres"), &m_nLogLimitIntervals[ltPostgres]));
+            Add(new CConfigCommand(_T("log/limit/interval"), _T("stream"), &m_nLogLimitIntervals[ltStream]));
+            Add(new CConfigCommand(_T("log/limit/interval"), _T("debug"), &m_nLogLimitIntervals[ltDebug]));
+
+            Add(new CConfigCommand(_T("log/access"), _T("sample"), &m_nAccessSample));
+            Add(new CConfigCommand(_T("log/access"), _T("slow"), &m_nAccessSlow));
+
+            Add(new CConfigCommand(_T("metrics"), _T("enable"), &m_fMetrics));
+            Add(new CConfigCommand(_T("metrics"), _T("host"), m_sMetricsHost.c_str(), [this](const auto & AValue) { SetMetricsHost(AValue); }));
+            Add(new CConfigCommand(_T("status"), _T("enable"), &m_fStatus));
+            Add(new CConfigCommand(_T("status"), _T("host"), m_sStatusHost.c_str(), [this](const auto & AValue) { SetStatusHost(AValue); }));
 #else
             Add(new CConfigCommand(_T("main"), _T("user"), m_sUser.c_str(), std::bind(&CConfig::SetUser, this, _1)));
             Add(new CConfigCommand(_T("main"), _T("group"), m_sGroup.c_str(), std::bind(&CConfig::SetGroup, this, _1)));
@@ -594,6 +718,7 @@ namespace Apostol {
             Add(new CConfigCommand(_T("server"), _T("listen"), m_sListen.c_str(), std::bind(&CConfig::SetListen, this, _1)));
             Add(new CConfigCommand(_T("server"), _T("port"), &m_nPort));
             Add(new CConfigCommand(_T("server"), _T("timeout"), &m_nTimeOut));
+            Add(new CConfigCommand(_T("server"), _T("reuseport"), &m_fReusePort));
             Add(new CConfigCommand(_T("server"), _T("root"), m_sDocRoot.c_str(), std::bind(&CConfig::SetDocRoot, this, _1)));
 
             Add(new CConfigCommand(_T("cache"), _T("prefix"), m_sCachePrefix.c_str(), std::bind(&CConfig::SetCachePrefix, this, _1)));
@@ -609,6 +734,39 @@ namespace Apostol {
 
             Add(new CConfigCommand(_T("postgres/poll"), _T("min"), &m_nPostgresPollMin));
             Add(new CConfigCommand(_T("postgres/poll"), _T("max"), &m_nPostgresPollMax));
+
+            Add(new CConfigCommand(_T("postgres/batch"), _T("enable"), &m_fPostgresBatch));
+            Add(new CConfigCommand(_T("postgres/batch"), _T("size"), &m_nPostgresBatchSize));
+
+            Add(new CConfigCommand(_T("cache"), _T("files"), &m_nFileCacheSize));
+            Add(new CConfigCommand(_T("cache"), _T("memory"), &m_nMemoryCacheSize));
+            Add(new CConfigCommand(_T("cache"), _T("memory_max_file"), &m_nMemoryCacheFile));
+            Add(new CConfigCommand(_T("cache"), _T("query"), &m_nQueryCacheSize));
+            Add(new CConfigCommand(_T("cache"), _T("query_ttl"), &m_nQueryCacheTTL));
+
+            Add(new CConfigCommand(_T("log/ring"), _T("enable"), &m_fLogRing));
+            Add(new CConfigCommand(_T("log/ring"), _T("size"), &m_nLogRingSize));
+
+            Add(new CConfigCommand(_T("log/rotate"), _T("size"), &m_nLogRotateSize));
+            Add(new CConfigCommand(_T("log/rotate"), _T("count"), &m_nLogRotateCount));
+
+            Add(new CConfigCommand(_T("log/limit"), _T("error"), &m_nLogLimit[ltError]));
+            Add(new CConfigCommand(_T("log/limit"), _T("postgres"), &m_nLogLimit[ltPostgres]));
+            Add(new CConfigCommand(_T("log/limit"), _T("stream"), &m_nLogLimit[ltStream]));
+            Add(new CConfigCommand(_T("log/limit"), _T("debug"), &m_nLogLimit[ltDebug]));
+            Add(new CConfigCommand(_T("log/limit"), _T("interval"), &m_nLogLimitInterval));
+            Add(new CConfigCommand(_T("log/limit/interval"), _T("error"), &m_nLogLimitIntervals[ltError]));
+            Add(new CConfigCommand(_T("log/limit/interval"), _T("postgres"), &m_nLogLimitIntervals[ltPostgres]));
+            Add(new CConfigCommand(_T("log/limit/interval"), _T("stream"), &m_nLogLimitIntervals[ltStream]));
+            Add(new CConfigCommand(_T("log/limit/interval"), _T("debug"), &m_nLogLimitIntervals[ltDebug]));
+
+            Add(new CConfigCommand(_T("log/access"), _T("sample"), &m_nAccessSample));
+            Add(new CConfigCommand(_T("log/access"), _T("slow"), &m_nAccessSlow));
+
+            Add(new CConfigCommand(_T("metrics"), _T("enable"), &m_fMetrics));
+            Add(new CConfigCommand(_T("metrics"), _T("host"), m_sMetricsHost.c_str(), std::bind(&CConfig::SetMetricsHost, this, _1)));
+            Add(new CConfigCommand(_T("status"), _T("enable"), &m_fStatus));
+            Add(new CConfigCommand(_T("status"), _T("host"), m_sStatusHost.c_str(), std::bind(&CConfig::SetStatusHost, this, _1)));
 #endif
         }
         //--------------------------------------------------------------------------------------------------------------
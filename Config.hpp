@@ -285,12 +285,44 @@ namespace Apostol {
             bool m_fHelper;
             bool m_fDaemon;
 
+            bool m_fReusePort;
+
             bool m_fPostgresConnect;
             bool m_fPostgresNotice;
 
             uint32_t m_nPostgresPollMin;
             uint32_t m_nPostgresPollMax;
 
+            bool m_fPostgresBatch;
+            uint32_t m_nPostgresBatchSize;
+
+            uint32_t m_nFileCacheSize;
+
+            uint32_t m_nMemoryCacheSize;
+            uint32_t m_nMemoryCacheFile;
+
+            uint32_t m_nQueryCacheSize;
+            uint32_t m_nQueryCacheTTL;
+
+            bool m_fLogRing;
+            uint32_t m_nLogRingSize;
+
+            uint32_t m_nLogRotateSize;
+            uint32_t m_nLogRotateCount;
+
+            uint32_t m_nLogLimit[ltDebug + 1];
+            uint32_t m_nLogLimitInterval;
+            uint32_t m_nLogLimitIntervals[ltDebug + 1];
+
+            uint32_t m_nAccessSample;
+            uint32_t m_nAccessSlow;
+
+            bool m_fMetrics;
+            bool m_fStatus;
+
+            CString m_sMetricsHost;
+            CString m_sStatusHost;
+
             CString m_sUser;
             CString m_sGroup;
             CString m_sListen;
@@ -339,6 +371,8 @@ namespace Apostol {
             void SetLockFile(LPCTSTR AValue);
             void SetDocRoot(LPCTSTR AValue);
             void SetCachePrefix(LPCTSTR AValue);
+            void SetMetricsHost(LPCTSTR AValue);
+            void SetStatusHost(LPCTSTR AValue);
 
             void SetErrorLog(LPCTSTR AValue);
             void SetAccessLog(LPCTSTR AValue);
@@ -383,6 +417,8 @@ namespace Apostol {
 
             uint32_t Port() const { return m_nPort; };
 
+            bool ReusePort() const { return m_fReusePort; };
+
             int TimeOut() const { return m_nTimeOut; };
             int ConnectTimeOut() const { return m_nConnectTimeOut; };
 
@@ -395,6 +431,39 @@ namespace Apostol {
 
             size_t PostgresPollMax() const { return (size_t) m_nPostgresPollMax; };
 
+            bool PostgresBatch() const { return m_fPostgresBatch; };
+            size_t PostgresBatchSize() const { return (size_t) m_nPostgresBatchSize; };
+
+            size_t FileCacheSize() const { return (size_t) m_nFileCacheSize; };
+
+            size_t MemoryCacheSize() const { return (size_t) m_nMemoryCacheSize; };
+            size_t MemoryCacheFile() const { return (size_t) m_nMemoryCacheFile; };
+
+            size_t QueryCacheSize() const { return (size_t) m_nQueryCacheSize; };
+            u_int QueryCacheTTL() const { return m_nQueryCacheTTL; };
+
+            bool LogRing() const { return m_fLogRing; };
+            size_t LogRingSize() const { return (size_t) m_nLogRingSize; };
+
+            size_t LogRotateSize() const { return (size_t) m_nLogRotateSize; };
+            u_int LogRotateCount() const { return m_nLogRotateCount; };
+
+            u_int LogLimit(CLogType Type) const { return m_nLogLimit[Type]; };
+            /// The interval of the log type, [log/limit] interval unless set in [log/limit/interval]
+            u_int LogLimitInterval(CLogType Type) const {
+                return m_nLogLimitIntervals[Type] != 0 ? m_nLogLimitIntervals[Type] : m_nLogLimitInterval;
+            };
+
+            u_int AccessSample() const { return m_nAccessSample; };
+            u_int AccessSlow() const { return m_nAccessSlow; };
+
+            bool Metrics() const { return m_fMetrics; };
+            /// Hosts the metrics location answers for, separated by spaces or commas, "*" - any
+            const CString& MetricsHost() const { return m_sMetricsHost; };
+            bool Status() const { return m_fStatus; };
+            /// Hosts the status location answers for, as MetricsHost()
+            const CString& StatusHost() const { return m_sStatusHost; };
+
             const CString& User() const { return m_sUser; };
             void User(const CString& AValue) { SetUser(AValue.c_str()); };
             void User(LPCTSTR AValue) { SetUser(AValue); };
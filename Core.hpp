@@ -27,6 +27,26 @@ Author:
 
 #include <wait.h>
 #include <execinfo.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <string>
+#include <deque>
+#include <list>
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
 //----------------------------------------------------------------------------------------------------------------------
 
 #include "delphi.hpp"
@@ -56,13 +56,344 @@ namespace Apostol {
 
         //--------------------------------------------------------------------------------------------------------------
 
+        //-- CCachedTime -----------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        time_t CCachedTime::m_Seconds = 0;
+        u_int CCachedTime::m_MSeconds = 0;
+        long CCachedTime::m_GMTOff = 0;
+
+        TCHAR CCachedTime::m_LogTime[] = {0};
+        TCHAR CCachedTime::m_AccessTime[] = {0};
+        TCHAR CCachedTime::m_HTTPTime[] = {0};
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CCachedTime::Update() {
+            struct timespec ts = {};
+            struct tm tm = {};
+
+            clock_gettime(CLOCK_REALTIME, &ts);
+
+            m_MSeconds = (u_int) (ts.tv_nsec / 1000000);
+
+            if (m_Seconds == ts.tv_sec)
+                return;
+
+            m_Seconds = ts.tv_sec;
+
+            if (localtime_r(&m_Seconds, &tm) != nullptr) {
+                m_GMTOff = tm.tm_gmtoff;
+                strftime(m_LogTime, sizeof(m_LogTime), "%Y/%m/%d %H:%M:%S", &tm);
+                strftime(m_AccessTime, sizeof(m_AccessTime), "%d/%b/%Y:%T %z", &tm);
+            }
+
+            if (gmtime_r(&m_Seconds, &tm) != nullptr) {
+                strftime(m_HTTPTime, sizeof(m_HTTPTime), "%a, %d %b %Y %T GMT", &tm);
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CCachedTime::SigSafeUpdate() {
+            struct timespec ts = {};
+
+            clock_gettime(CLOCK_REALTIME, &ts);
+
+            // m_Seconds is left alone: the next Update() still refreshes the other strings
+            const auto local = (long) ts.tv_sec + m_GMTOff;
+
+            const long sec = local % 86400;
+
+            // Civil date from the day number, the same arithmetic as ngx_gmtime()
+            long days = local / 86400 + 719468;
+
+            const long era = days / 146097;
+            const long doe = days - era * 146097;
+            const long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+            const long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+            const long mp = (5 * doy + 2) / 153;
+
+            const long mday = doy - (153 * mp + 2) / 5 + 1;
+            const long mon = mp < 10 ? mp + 3 : mp - 9;
+            const long year = yoe + era * 400 + (mon <= 2 ? 1 : 0);
+
+            auto digits = [](TCHAR *ADest, long AValue, int ACount) {
+                for (int i = ACount - 1; i >= 0; --i) {
+                    ADest[i] = (TCHAR) ('0' + AValue % 10);
+                    AValue /= 10;
+                }
+            };
+
+            // "%Y/%m/%d %H:%M:%S"
+            TCHAR *p = m_LogTime;
+
+            digits(p, year, 4); p[4] = '/';
+            digits(p + 5, mon, 2); p[7] = '/';
+            digits(p + 8, mday, 2); p[10] = ' ';
+            digits(p + 11, sec / 3600, 2); p[13] = ':';
+            digits(p + 14, sec / 60 % 60, 2); p[16] = ':';
+            digits(p + 17, sec % 60, 2); p[19] = '\0';
+
+            m_MSeconds = (u_int) (ts.tv_nsec / 1000000);
+        }
+
+        //--------------------------------------------------------------------------------------------------------------
+
         //-- CLogFile --------------------------------------------------------------------------------------------------
 
         //--------------------------------------------------------------------------------------------------------------
 
         CLogFile::CLogFile(CLog *ALog, const CString &FileName):
                 CFile(FileName, FILE_APPEND | FILE_CREATE_OR_OPEN),
-                CCollectionItem(ALog), m_uLevel(ALog->Level()), m_LogType(ltError) {
+                CCollectionItem(ALog), m_pLog(ALog), m_uLevel(ALog->Level()), m_LogType(ltError) {
+
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CLogFile::Reopen(uid_t AUser, gid_t AGroup) {
+            // Standard streams are not ours to reopen
+            if (Handle() <= STDERR_FILENO)
+                return true;
+
+            const int fd = ::open(FileName().c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+            if (fd == -1)
+                return false;
+
+            // A file the master just created as root must stay writable for the workers after SetUser()
+            if ((AUser != (uid_t) -1 || AGroup != (gid_t) -1) && ::geteuid() == 0) {
+                if (::fchown(fd, AUser, AGroup) == -1) {
+                    m_pLog->Error(APP_LOG_ALERT, errno, _T("fchown() \"%s\" failed"), FileName().c_str());
+                }
+            }
+
+            // dup2() replaces the open file in place and closes the old one: the handle in the dispatch table
+            // stays valid, so no write ever sees a closed descriptor
+            const int result = ::dup2(fd, Handle());
+            const int error = errno;
+
+            ::close(fd);
+
+            errno = error;
+
+            return result != -1;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLogFile::SetLevel(u_int Value) {
+            m_uLevel = Value;
+            m_pLog->UpdateTargets();
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLogFile::SetLogType(CLogType Value) {
+            m_LogType = Value;
+            m_pLog->UpdateTargets();
+        }
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CLogRing --------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        CLogRing::CLogRing(): m_pHeader(nullptr), m_AreaSize(0), m_Slot(-1), m_Signal(0), m_Writing(0) {
+
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CLogRing::~CLogRing() {
+            Destroy();
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLogRing::Create(int Count, size_t Size) {
+            Destroy();
+
+            // Records are 8-byte aligned, a power of two size keeps them from straddling the end
+            size_t RingSize = 4096;
+            while (RingSize < Size)
+                RingSize <<= 1;
+
+            const auto AreaSize = sizeof(CHeader) + Count * (sizeof(CRing) + RingSize) + sizeof(CRing);
+
+            const auto pArea = mmap(nullptr, AreaSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (pArea == MAP_FAILED)
+                throw EOSError(errno, _T("mmap(%lu) for the log ring failed"), (unsigned long) AreaSize);
+
+            m_pHeader = new (pArea) CHeader();
+            m_pHeader->Heartbeat = time(nullptr);
+            m_pHeader->Count = Count;
+            m_pHeader->Size = RingSize;
+
+            for (int i = 0; i < Count; ++i) {
+                auto pRing = new (GetRing(i)) CRing();
+                pRing->Owner = 0;
+                pRing->Head = 0;
+                pRing->Tail = 0;
+            }
+
+            m_AreaSize = AreaSize;
+            m_Slot = -1;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLogRing::Destroy() {
+            if (m_pHeader != nullptr) {
+                munmap(m_pHeader, m_AreaSize);
+                m_pHeader = nullptr;
+                m_AreaSize = 0;
+            }
+            m_Slot = -1;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CLogRing::CRing *CLogRing::GetRing(int Index) const {
+            const auto Offset = (sizeof(CHeader) + alignof(CRing) - 1) / alignof(CRing) * alignof(CRing);
+            return (CRing *) ((char *) m_pHeader + Offset + Index * (sizeof(CRing) + m_pHeader->Size));
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        char *CLogRing::GetData(int Index) const {
+            return (char *) GetRing(Index) + sizeof(CRing);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLogRing::CopyTo(int Index, uint64_t Pos, const void *Source, size_t Size) const {
+            const auto RingSize = m_pHeader->Size;
+            const auto Offset = Pos & (RingSize - 1);
+            const auto First = Min(Size, (size_t) (RingSize - Offset));
+
+            ::memcpy(GetData(Index) + Offset, Source, First);
+            if (First < Size)
+                ::memcpy(GetData(Index), (const char *) Source + First, Size - First);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLogRing::CopyFrom(int Index, uint64_t Pos, void *Dest, size_t Size) const {
+            const auto RingSize = m_pHeader->Size;
+            const auto Offset = Pos & (RingSize - 1);
+            const auto First = Min(Size, (size_t) (RingSize - Offset));
+
+            ::memcpy(Dest, GetData(Index) + Offset, First);
+            if (First < Size)
+                ::memcpy((char *) Dest + First, GetData(Index), Size - First);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CLogRing::Attach() {
+            if (m_pHeader == nullptr)
+                return false;
+
+            const auto pid = getpid();
+
+            for (int i = 0; i < (int) m_pHeader->Count; ++i) {
+                auto &Owner = GetRing(i)->Owner;
+
+                pid_t Current = Owner.load();
+                // A slot is free, or left behind by an exited process; undrained records are kept
+                if (Current == 0 || (Current != pid && kill(Current, 0) == -1 && errno == ESRCH)) {
+                    if (Owner.compare_exchange_strong(Current, pid)) {
+                        m_Slot = i;
+                        return true;
+                    }
+                }
+            }
+
+            m_Slot = -1;
+            return false;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CLogRing::Write(CLogType ALogType, u_int ALevel, LPCSTR ABuffer, size_t ASize) {
+            if (m_pHeader == nullptr || m_Slot == -1)
+                return false;
+
+            // A record from a signal handler may be the last one before the process dies (the SIGSEGV backtrace),
+            // or may interrupt a record being filled: both are written directly
+            if (m_Signal || m_Writing)
+                return false;
+
+            // The master drains on a timer; if it stopped doing so, write directly
+            if (CCachedTime::Seconds() - m_pHeader->Heartbeat.load(std::memory_order_acquire) > LOG_RING_TIMEOUT)
+                return false;
+
+            auto pRing = GetRing(m_Slot);
+
+            const auto Size = (sizeof(CRecord) + ASize + 7) & ~((size_t) 7);
+
+            const auto Head = pRing->Head.load(std::memory_order_relaxed);
+            const auto Tail = pRing->Tail.load(std::memory_order_acquire);
+
+            if (Size > m_pHeader->Size - (Head - Tail))
+                return false;
+
+            m_Writing = 1;
+
+            const CRecord Record = { (uint32_t) ASize, (uint16_t) ALogType, (uint16_t) ALevel };
+
+            CopyTo(m_Slot, Head, &Record, sizeof(Record));
+            CopyTo(m_Slot, Head + sizeof(Record), ABuffer, ASize);
+
+            pRing->Head.store(Head + Size, std::memory_order_release);
+
+            m_Writing = 0;
+
+            return true;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CLogRing::Read(std::vector<char> &Batch, std::vector<CLogRingRecord> &Records, u_int &Corrupted) {
+            Corrupted = 0;
+
+            if (m_pHeader == nullptr)
+                return false;
+
+            m_pHeader->Heartbeat.store(CCachedTime::Seconds(), std::memory_order_release);
+
+            for (int i = 0; i < (int) m_pHeader->Count; ++i) {
+                auto pRing = GetRing(i);
+
+                auto Tail = pRing->Tail.load(std::memory_order_relaxed);
+                const auto Head = pRing->Head.load(std::memory_order_acquire);
+
+                // The ring is written by a child that may have died or gone astray: nothing in it is trusted.
+                // A bad length drops whatever is left in the ring instead of reading past the records
+                if (Head < Tail || Head - Tail > m_pHeader->Size) {
+                    pRing->Tail.store(Head, std::memory_order_release);
+                    Corrupted++;
+                    continue;
+                }
+
+                while (Tail < Head) {
+                    CRecord Record = {};
+
+                    if (Head - Tail < sizeof(Record)) {
+                        Tail = Head;
+                        Corrupted++;
+                        break;
+                    }
+
+                    CopyFrom(i, Tail, &Record, sizeof(Record));
+
+                    if (Record.Length > Head - Tail - sizeof(Record) || Record.LogType > ltDebug) {
+                        Tail = Head;
+                        Corrupted++;
+                        break;
+                    }
+
+                    const auto Offset = Batch.size();
+                    Batch.resize(Offset + Record.Length);
+                    CopyFrom(i, Tail + sizeof(Record), Batch.data() + Offset, Record.Length);
+
+                    Records.push_back({Offset, Record.Length, (CLogType) Record.LogType, Record.Level});
+
+                    Tail += (sizeof(CRecord) + Record.Length + 7) & ~((size_t) 7);
+                }
+
+                pRing->Tail.store(Tail, std::memory_order_release);
+            }
+
+            return !Records.empty();
         }
 
         //--------------------------------------------------------------------------------------------------------------
@@ -92,6 +423,29 @@ namespace Apostol {
             m_CurrentIndex = -1;
             m_fUseStdErr = true;
             m_DiskFullTime = 0;
+            m_RotateTime = 0;
+            m_OwnerUser = (uid_t) -1;
+            m_OwnerGroup = (gid_t) -1;
+            m_AccessHead = 0;
+            m_AccessLength = 0;
+
+            for (auto &Level : m_uMaxLevel) {
+                Level = APP_LOG_STDERR;
+            }
+
+            for (auto &Limit : m_uLimit) {
+                Limit = 0;
+            }
+
+            for (auto &Interval : m_uLimitInterval) {
+                Interval = 10;
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CLog::~CLog() {
+            FlushAccess();
+            FlushRing();
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -132,99 +486,265 @@ namespace Apostol {
         }
         //--------------------------------------------------------------------------------------------------------------
 
-        void CLog::ErrorCore(u_int ALevel, int AError, LPCSTR AFormat, CLogType ALogType, va_list args) {
+        void CLog::ErrorCore(u_int ALevel, int AError, const void *ASite, LPCSTR AFormat, CLogType ALogType, va_list args) {
             const auto char_size = sizeof(TCHAR);
 
+            const bool to_file = ALevel <= m_uMaxLevel[ALogType];
+#ifdef _DEBUG
+            const bool to_console = true;
+#else
+            const bool to_console = UseStdErr() && m_uLevel >= ALevel;
+#endif
+            if (!to_file && !to_console)
+                return;
+
+            if (m_uLimit[ALogType] != 0 && ALevel >= APP_LOG_ERR && !Admit(ALevel, ASite, AFormat, ALogType))
+                return;
+
             const auto tid = (pid_t) syscall(SYS_gettid);
 
             TCHAR       *f, *last_f;
             TCHAR       *c, *last_c;
-            TCHAR       *last_a;
+            TCHAR       *head, *message, *message_end;
 
             ssize_t     n;
 
             bool        wrote_stderr;
 
-            TCHAR       time_str [LOG_MAX_ERROR_STR + 1] = {0};
-            TCHAR       args_str [LOG_MAX_ERROR_STR + 1] = {0};
-            TCHAR       file_str [LOG_MAX_ERROR_STR + 1] = {0};
-            TCHAR       cons_str [LOG_MAX_ERROR_STR + 1] = {0};
-
-            time_t      itime;
-            struct tm   *timeInfo;
+            TCHAR       file_str [LOG_MAX_ERROR_STR + 1];
+            TCHAR       cons_str [LOG_MAX_ERROR_STR + 1];
 
             last_f = file_str + LOG_MAX_ERROR_STR * char_size;
             last_c = cons_str + LOG_MAX_ERROR_STR * char_size;
-            last_a = args_str + LOG_MAX_ERROR_STR * char_size;
 
-            itime = time(&itime);
-            timeInfo = localtime(&itime);
+            // Messages logged before the first event loop cycle
+            if (CCachedTime::Seconds() == 0)
+                CCachedTime::Update();
 
-            strftime(time_str, LOG_MAX_ERROR_STR, "%Y/%m/%d %H:%M:%S", timeInfo);
+            const auto itime = CCachedTime::Seconds();
 
-            f = ld_slprintf(file_str, last_f, "[%s] ", time_str);
-            c = ld_slprintf(cons_str, last_c, COLOR_WHITE "[%s] ", time_str);
+            f = ld_slprintf(file_str, last_f, "[%s] ", CCachedTime::LogTime());
 
             /* pid#tid */
             f = ld_slprintf(f, last_f, "[%P] [" LOG_TID_T_FMT "] ", log_pid, tid);
-            c = ld_slprintf(c, last_c, "[%P] [" LOG_TID_T_FMT "] ", log_pid, tid);
+            head = f;
 
             f = ld_slprintf(f, last_f, "%V: ", &err_levels[ALevel]);
-            c = ld_slprintf(c, last_c, "%V", &level_colors[ALevel]);
 
-            ld_vslprintf(args_str, last_a, AFormat, args);
-
-            f = ld_slprintf(f, last_f, "%s", args_str);
-            c = ld_slprintf(c, last_c, "%s", args_str);
+            /* the message is formatted once, the console line copies it */
+            message = f;
+            f = ld_vslprintf(f, last_f, AFormat, args);
 
             if (AError) {
                 f = ErrNo(f, last_f, AError);
-                c = ErrNo(c, last_c, AError);
             }
 
             if (f > last_f - LINEFEED_SIZE) {
                 f = last_f - LINEFEED_SIZE;
             }
 
+            message_end = f;
+
             linefeed(f);
-            c = ld_slprintf(c, last_c, COLOR_OFF "\n");
+            *f = '\0';
+
+            c = cons_str;
+
+            if (to_console) {
+                auto append = [&c, last_c](const TCHAR *begin, const TCHAR *end) {
+                    const auto size = Min((size_t) (end - begin), (size_t) (last_c - c));
+                    ::memcpy(c, begin, size * sizeof(TCHAR));
+                    c += size;
+                };
+
+                c = ld_slprintf(c, last_c, COLOR_WHITE);
+                append(file_str, head);
+                c = ld_slprintf(c, last_c, "%V", &level_colors[ALevel]);
+                append(message, message_end);
+                c = ld_slprintf(c, last_c, COLOR_OFF "\n");
+                *c = '\0';
+            }
 
             wrote_stderr = false;
 
-            CLogFile *logfile = First();
-            while (logfile) {
-                if (logfile->LogType() == ALogType && logfile->Level() >= ALevel && itime != m_DiskFullTime) {
-                    n = write_fd(logfile->Handle(), file_str, f - file_str);
+            // Worker records go to the master through the shared ring, direct writes are the fallback
+            const bool to_ring = to_file && m_Ring.Attached() && m_Ring.Write(ALogType, ALevel, file_str, f - file_str);
 
-                    if (n == -1 && errno == ENOSPC) {
-                        DiskFullTime(itime);
-                    }
+            if (to_file) {
+                for (const auto &target : m_Targets[ALogType]) {
+                    if (target.Level >= ALevel && itime != m_DiskFullTime) {
+                        if (!to_ring) {
+                            n = write_fd(target.Handle, file_str, f - file_str);
 
-                    wrote_stderr = logfile->Handle() == STDERR_FILENO;
-                }
+                            if (n == -1 && errno == ENOSPC) {
+                                DiskFullTime(itime);
+                            }
+                        }
 
-                logfile = Next();
+                        wrote_stderr = target.Handle == STDERR_FILENO;
+                    }
+                }
             }
 #ifdef _DEBUG
             DebugMessage(_T("%s"), UseStdErr() ? cons_str : file_str);
 #else
-            if (UseStdErr() && m_uLevel >= ALevel && !wrote_stderr) {
+            if (to_console && !wrote_stderr) {
                 (void) write_console(STDERR_FILENO, cons_str, c - cons_str);
             }
 #endif
         }
         //--------------------------------------------------------------------------------------------------------------
 
+        static LPCSTR GSuppressedFormat = "%u similar messages suppressed: \"%s\"";
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// FNV-1a of the first LOG_BUCKET_FORMAT bytes of a format
+        static size_t FormatHash(LPCSTR AFormat) {
+            uint64_t Hash = 14695981039346656037ULL;
+
+            for (size_t i = 0; i < LOG_BUCKET_FORMAT && AFormat[i] != '\0'; ++i) {
+                Hash ^= (u_char) AFormat[i];
+                Hash *= 1099511628211ULL;
+            }
+
+            return (size_t) Hash;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// A bucket refilled for a whole interval with nothing to report is the same as a new one
+        static bool BucketIdle(const CLogBucket &ABucket, uint64_t ANow, uint64_t AInterval) {
+            return ABucket.Suppressed == 0 && ANow - ABucket.Updated >= AInterval;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        static void LogSuppressed(CLog *ALog, u_int ALevel, CLogType ALogType, u_int ACount, LPCSTR AFormat) {
+            switch (ALogType) {
+                case ltPostgres:
+                    ALog->Postgres(ALevel, GSuppressedFormat, ACount, AFormat);
+                    break;
+                case ltStream:
+                    ALog->Stream(GSuppressedFormat, ACount, AFormat);
+                    break;
+                case ltDebug:
+                    ALog->Debug(APP_LOG_DEBUG_ALL, GSuppressedFormat, ACount, AFormat);
+                    break;
+                default:
+                    ALog->Error(ALevel, 0, GSuppressedFormat, ACount, AFormat);
+                    break;
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CLog::Admit(u_int ALevel, const void *ASite, LPCSTR AFormat, CLogType ALogType) {
+            if (AFormat == GSuppressedFormat)
+                return true;
+
+            const auto Limit = (double) m_uLimit[ALogType];
+            const auto Interval = (uint64_t) std::max(m_uLimitInterval[ALogType], 1u) * 1000;
+            const auto Now = (uint64_t) CCachedTime::Seconds() * 1000 + CCachedTime::MSeconds();
+
+            auto &Buckets = m_Buckets[ALogType];
+
+            CLogSite Site {ASite, FormatHash(AFormat)};
+
+            auto it = Buckets.find(Site);
+            if (it == Buckets.end()) {
+                if (Buckets.size() >= LOG_BUCKETS_MAX) {
+                    for (auto Item = Buckets.begin(); Item != Buckets.end(); ) {
+                        if (BucketIdle(Item->second, Now, Interval))
+                            Item = Buckets.erase(Item);
+                        else
+                            ++Item;
+                    }
+                }
+
+                // Still full: the rest of the messages of this site share one bucket whatever their text
+                if (Buckets.size() >= LOG_BUCKETS_MAX) {
+                    Site.Format = 0;
+                    it = Buckets.find(Site);
+                }
+
+                if (it == Buckets.end()) {
+                    CLogBucket Bucket {Limit, Now, CCachedTime::Seconds(), 0, ALevel, {}};
+                    strncpy(Bucket.Format, AFormat, LOG_BUCKET_FORMAT);
+                    it = Buckets.emplace(Site, Bucket).first;
+                }
+            }
+
+            auto &Bucket = it->second;
+
+            Bucket.Tokens = std::min(Limit, Bucket.Tokens + (double) (Now - Bucket.Updated) * Limit / (double) Interval);
+            Bucket.Updated = Now;
+
+            if (Bucket.Tokens < 1) {
+                Bucket.Suppressed++;
+                Bucket.Level = Min(Bucket.Level, ALevel);
+                return false;
+            }
+
+            Bucket.Tokens -= 1;
+
+            if (Bucket.Suppressed != 0) {
+                const auto Count = Bucket.Suppressed;
+
+                Bucket.Suppressed = 0;
+                Bucket.Reported = CCachedTime::Seconds();
+
+                LogSuppressed(this, Bucket.Level, ALogType, Count, Bucket.Format);
+            }
+
+            return true;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLog::SetLimit(CLogType ALogType, u_int AMessages, u_int AInterval) {
+            m_uLimit[ALogType] = AMessages;
+            m_uLimitInterval[ALogType] = AInterval;
+            m_Buckets[ALogType].clear();
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLog::FlushSuppressed() {
+            const auto Now = CCachedTime::Seconds();
+            const auto NowMs = (uint64_t) Now * 1000 + CCachedTime::MSeconds();
+
+            for (int i = 0; i <= ltDebug; ++i) {
+                auto &Buckets = m_Buckets[i];
+                const auto Interval = (uint64_t) std::max(m_uLimitInterval[i], 1u) * 1000;
+
+                for (auto Bucket = Buckets.begin(); Bucket != Buckets.end(); ) {
+                    auto &Item = Bucket->second;
+
+                    if (BucketIdle(Item, NowMs, Interval)) {
+                        Bucket = Buckets.erase(Bucket);
+                        continue;
+                    }
+
+                    if (Item.Suppressed != 0 && (u_int) (Now - Item.Reported) >= m_uLimitInterval[i]) {
+                        const auto Count = Item.Suppressed;
+
+                        Item.Suppressed = 0;
+                        Item.Reported = Now;
+
+                        LogSuppressed(this, Item.Level, (CLogType) i, Count, Item.Format);
+                    }
+
+                    ++Bucket;
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
         void CLog::Error(u_int ALevel, int AErrNo, LPCSTR AFormat, ...) {
             va_list args;
             va_start(args, AFormat);
-            ErrorCore(ALevel, AErrNo, AFormat, ltError, args);
+            ErrorCore(ALevel, AErrNo, LOG_CALL_SITE, AFormat, ltError, args);
             va_end(args);
         }
         //--------------------------------------------------------------------------------------------------------------
 
         void CLog::Error(u_int ALevel, int AErrNo, LPCSTR AFormat, va_list args) {
-            ErrorCore(ALevel, AErrNo, AFormat, ltError, args);
+            ErrorCore(ALevel, AErrNo, LOG_CALL_SITE, AFormat, ltError, args);
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -232,7 +752,7 @@ namespace Apostol {
             if (m_uDebugLevel & ADebugLevel) {
                 va_list args;
                 va_start(args, AFormat);
-                ErrorCore(APP_LOG_DEBUG, 0, AFormat, ltDebug, args);
+                ErrorCore(APP_LOG_DEBUG, 0, LOG_CALL_SITE, AFormat, ltDebug, args);
                 va_end(args);
             }
         }
@@ -240,7 +760,7 @@ namespace Apostol {
 
         void CLog::Debug(u_int ADebugLevel, LPCSTR AFormat, va_list args) {
             if (m_uDebugLevel & ADebugLevel) {
-                ErrorCore(APP_LOG_DEBUG, 0, AFormat, ltDebug, args);
+                ErrorCore(APP_LOG_DEBUG, 0, LOG_CALL_SITE, AFormat, ltDebug, args);
             }
         }
         //--------------------------------------------------------------------------------------------------------------
@@ -248,39 +768,39 @@ namespace Apostol {
         void CLog::Warning(LPCSTR AFormat, ...) {
             va_list args;
             va_start(args, AFormat);
-            Error(APP_LOG_WARN, 0, AFormat, args);
+            ErrorCore(APP_LOG_WARN, 0, LOG_CALL_SITE, AFormat, ltError, args);
             va_end(args);
         }
         //--------------------------------------------------------------------------------------------------------------
 
         void CLog::Warning(LPCSTR AFormat, va_list args) {
-            Error(APP_LOG_WARN, 0, AFormat,  args);
+            ErrorCore(APP_LOG_WARN, 0, LOG_CALL_SITE, AFormat, ltError, args);
         }
         //--------------------------------------------------------------------------------------------------------------
 
         void CLog::Notice(LPCSTR AFormat, ...) {
             va_list args;
             va_start(args, AFormat);
-            Error(APP_LOG_NOTICE, 0, AFormat, args);
+            ErrorCore(APP_LOG_NOTICE, 0, LOG_CALL_SITE, AFormat, ltError, args);
             va_end(args);
         }
         //--------------------------------------------------------------------------------------------------------------
 
         void CLog::Notice(LPCSTR AFormat, va_list args) {
-            Error(APP_LOG_NOTICE, 0, AFormat,  args);
+            ErrorCore(APP_LOG_NOTICE, 0, LOG_CALL_SITE, AFormat, ltError, args);
         }
         //--------------------------------------------------------------------------------------------------------------
 
         void CLog::Message(LPCSTR AFormat, ...) {
             va_list args;
             va_start(args, AFormat);
-            Error(APP_LOG_INFO, 0, AFormat, args);
+            ErrorCore(APP_LOG_INFO, 0, LOG_CALL_SITE, AFormat, ltError, args);
             va_end(args);
         }
         //--------------------------------------------------------------------------------------------------------------
 
         void CLog::Message(LPCSTR AFormat, va_list args) {
-            Error(APP_LOG_INFO, 0, AFormat,  args);
+            ErrorCore(APP_LOG_INFO, 0, LOG_CALL_SITE, AFormat, ltError, args);
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -295,41 +815,88 @@ namespace Apostol {
         void CLog::Access(LPCSTR AFormat, va_list args) {
             TCHAR szBuffer[MAX_ERROR_STR + 1] = {0};
             size_t LSize = MAX_ERROR_STR;
-            CLogFile *logfile = First();
-            while (logfile) {
-                if (logfile->LogType() == ltAccess) {
-                    chVERIFY(SUCCEEDED(StringPCchVPrintf(szBuffer, &LSize, AFormat, args)));
-                    write_fd(logfile->Handle(), szBuffer, LSize);
+            chVERIFY(SUCCEEDED(StringPCchVPrintf(szBuffer, &LSize, AFormat, args)));
+            AccessWrite(szBuffer, LSize);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLog::AccessWrite(LPCSTR ABuffer, size_t ASize) {
+            if (m_AccessLength + ASize > LOG_ACCESS_BUFFER)
+                FlushAccess();
+
+            if (ASize > LOG_ACCESS_BUFFER) {
+                if (!m_Targets[ltAccess].empty())
+                    write_fd(m_Targets[ltAccess].front().Handle, (char *) ABuffer, ASize);
+                return;
+            }
+
+            size_t Tail = (m_AccessHead + m_AccessLength) % LOG_ACCESS_BUFFER;
+            size_t Size = Min(ASize, (size_t) LOG_ACCESS_BUFFER - Tail);
+
+            ::memcpy(m_AccessBuffer + Tail, ABuffer, Size);
+            if (Size < ASize)
+                ::memcpy(m_AccessBuffer, ABuffer + Size, ASize - Size);
+
+            m_AccessLength += ASize;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLog::FlushAccess() {
+            if (m_AccessLength == 0)
+                return;
+
+            const int Handle = m_Targets[ltAccess].empty() ? -1 : m_Targets[ltAccess].front().Handle;
+
+            while (Handle != -1 && m_AccessLength > 0) {
+                struct iovec iov[2];
+
+                const auto First = Min(m_AccessLength, (size_t) LOG_ACCESS_BUFFER - m_AccessHead);
+
+                iov[0].iov_base = m_AccessBuffer + m_AccessHead;
+                iov[0].iov_len = First;
+                iov[1].iov_base = m_AccessBuffer;
+                iov[1].iov_len = m_AccessLength - First;
+
+                const auto n = ::writev(Handle, iov, iov[1].iov_len == 0 ? 1 : 2);
+                if (n <= 0) {
+                    if (n == -1 && errno == EINTR)
+                        continue;
                     break;
                 }
-                logfile = Next();
+
+                m_AccessHead = (m_AccessHead + n) % LOG_ACCESS_BUFFER;
+                m_AccessLength -= n;
             }
+
+            // Lines that could not be written are dropped, as the direct write() did
+            m_AccessHead = 0;
+            m_AccessLength = 0;
         }
         //--------------------------------------------------------------------------------------------------------------
 
         void CLog::Stream(LPCSTR AFormat, ...) {
             va_list args;
             va_start(args, AFormat);
-            Stream(AFormat, args);
+            ErrorCore(APP_LOG_DEBUG, 0, LOG_CALL_SITE, AFormat, ltStream, args);
             va_end(args);
         }
         //--------------------------------------------------------------------------------------------------------------
 
         void CLog::Stream(LPCSTR AFormat, va_list args) {
-            ErrorCore(APP_LOG_DEBUG, 0, AFormat, ltStream, args);
+            ErrorCore(APP_LOG_DEBUG, 0, LOG_CALL_SITE, AFormat, ltStream, args);
         }
         //--------------------------------------------------------------------------------------------------------------
 
         void CLog::Postgres(u_int ALevel, LPCSTR AFormat, ...) {
             va_list args;
             va_start(args, AFormat);
-            Postgres(ALevel, AFormat, args);
+            ErrorCore(ALevel, 0, LOG_CALL_SITE, AFormat, ltPostgres, args);
             va_end(args);
         }
         //--------------------------------------------------------------------------------------------------------------
 
         void CLog::Postgres(u_int ALevel, LPCSTR AFormat, va_list args) {
-            ErrorCore(ALevel, 0, AFormat, ltPostgres, args);
+            ErrorCore(ALevel, 0, LOG_CALL_SITE, AFormat, ltPostgres, args);
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -343,6 +910,8 @@ namespace Apostol {
                 LogFile = new CLogFile(this, FileName);
                 LogFile->Level(ALevel);
                 LogFile->Open();
+
+                UpdateTargets();
             }
 
             return LogFile;
@@ -416,6 +985,138 @@ namespace Apostol {
         }
         //--------------------------------------------------------------------------------------------------------------
 
+        void CLog::FlushRing() {
+            if (!m_Ring.Active() || m_Ring.Attached())
+                return;
+
+            m_RingBatch.clear();
+            m_RingRecords.clear();
+
+            u_int Corrupted = 0;
+
+            if (!m_Ring.Read(m_RingBatch, m_RingRecords, Corrupted)) {
+                if (Corrupted != 0)
+                    Error(APP_LOG_ALERT, 0, _T("log ring: %u corrupted ring(s) reset"), Corrupted);
+                return;
+            }
+
+            struct iovec iov[IOV_MAX];
+
+            for (int i = 0; i <= ltDebug; ++i) {
+                for (const auto &target : m_Targets[i]) {
+                    int count = 0;
+
+                    for (const auto &Record : m_RingRecords) {
+                        if (Record.LogType == i && target.Level >= Record.Level) {
+                            iov[count].iov_base = m_RingBatch.data() + Record.Offset;
+                            iov[count].iov_len = Record.Length;
+
+                            if (++count == IOV_MAX) {
+                                (void) ::writev(target.Handle, iov, count);
+                                count = 0;
+                            }
+                        }
+                    }
+
+                    if (count > 0)
+                        (void) ::writev(target.Handle, iov, count);
+                }
+            }
+
+            if (Corrupted != 0)
+                Error(APP_LOG_ALERT, 0, _T("log ring: %u corrupted ring(s) reset"), Corrupted);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLog::Reopen() {
+            // Buffered access lines belong to the old file
+            FlushAccess();
+
+            for (int i = 0; i < Count(); ++i) {
+                const auto pLogFile = LogFiles(i);
+
+                if (!pLogFile->Reopen(m_OwnerUser, m_OwnerGroup)) {
+                    Error(APP_LOG_ALERT, errno, _T("could not reopen log file \"%s\""), pLogFile->FileName().c_str());
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CLog::Rotate(size_t ASize, u_int ACount) {
+            if (ASize == 0 || m_RotateTime == CCachedTime::Seconds())
+                return false;
+
+            m_RotateTime = CCachedTime::Seconds();
+
+            TCHAR szOld[PATH_MAX + 1];
+            TCHAR szNew[PATH_MAX + 1];
+
+            struct stat st = {};
+            bool rotated = false;
+
+            for (int i = 0; i < Count(); ++i) {
+                const auto pLogFile = LogFiles(i);
+
+                if (pLogFile->Handle() <= STDERR_FILENO)
+                    continue;
+
+                if (fstat(pLogFile->Handle(), &st) == -1 || !S_ISREG(st.st_mode) || (size_t) st.st_size < ASize)
+                    continue;
+
+                const auto &caFileName = pLogFile->FileName();
+
+                // file.log -> file.log.1 -> ... -> file.log.N, the oldest one is overwritten
+                for (u_int n = ACount > 0 ? ACount - 1 : 0; n > 0; --n) {
+                    ::snprintf(szOld, sizeof(szOld), "%s.%u", caFileName.c_str(), n);
+                    ::snprintf(szNew, sizeof(szNew), "%s.%u", caFileName.c_str(), n + 1);
+                    if (::rename(szOld, szNew) == -1 && errno != ENOENT) {
+                        Error(APP_LOG_ALERT, errno, _T("rename() \"%s\" to \"%s\" failed"), szOld, szNew);
+                    }
+                }
+
+                if (ACount > 0) {
+                    ::snprintf(szNew, sizeof(szNew), "%s.1", caFileName.c_str());
+                    if (::rename(caFileName.c_str(), szNew) == -1) {
+                        Error(APP_LOG_ALERT, errno, _T("rename() \"%s\" to \"%s\" failed"), caFileName.c_str(), szNew);
+                        continue;
+                    }
+                } else if (::unlink(caFileName.c_str()) == -1) {
+                    Error(APP_LOG_ALERT, errno, _T("unlink() \"%s\" failed"), caFileName.c_str());
+                    continue;
+                }
+
+                rotated = true;
+            }
+
+            if (rotated)
+                Reopen();
+
+            return rotated;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLog::UpdateTargets() {
+            for (int i = 0; i <= ltDebug; ++i) {
+                m_Targets[i].clear();
+                m_uMaxLevel[i] = APP_LOG_STDERR;
+            }
+
+            for (int i = 0; i < Count(); ++i) {
+                const auto pLogFile = LogFiles(i);
+
+                if (pLogFile->Handle() < 0)
+                    continue;
+
+                const auto LogType = pLogFile->LogType();
+
+                m_Targets[LogType].push_back({pLogFile->Handle(), pLogFile->Level()});
+
+                if (pLogFile->Level() > m_uMaxLevel[LogType])
+                    m_uMaxLevel[LogType] = pLogFile->Level();
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
         void CLog::RedirectStdErr() {
             CLogFile *log = Last();
             while (log && (log->LogType() != ltDebug || log->Handle() == STDERR_FILENO)) {
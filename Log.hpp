@@ -26,6 +26,15 @@ Author:
 //----------------------------------------------------------------------------------------------------------------------
 
 #define LOG_MAX_ERROR_STR     2048
+#define LOG_ACCESS_BUFFER     (64 * 1024)
+#define LOG_RING_TIMEOUT      3
+#define LOG_RING_INTERVAL     100
+
+/// The caller of a CLog entry point, rate limiting buckets are kept per call site
+#define LOG_CALL_SITE         __builtin_return_address(0)
+/// Bytes of the format kept with a bucket, buckets per log type
+#define LOG_BUCKET_FORMAT     64
+#define LOG_BUCKETS_MAX       1024
 //----------------------------------------------------------------------------------------------------------------------
 
 #define APP_LOG_STDERR            0
@@ -154,6 +163,85 @@ namespace Apostol {
 
         //--------------------------------------------------------------------------------------------------------------
 
+        //-- CCachedTime -----------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Process-wide wall clock, refreshed before each dispatched request, connection, Postgres result
+        /// and timer tick. Update() is a clock_gettime() unless the second changed: only then are the strings formatted.
+        class CCachedTime {
+        private:
+
+            static time_t m_Seconds;
+            static u_int m_MSeconds;
+
+            /// UTC offset of the local time as of the last Update(), for SigSafeUpdate()
+            static long m_GMTOff;
+
+            static TCHAR m_LogTime[sizeof("1970/09/28 12:00:00")];
+            static TCHAR m_AccessTime[sizeof("28/Sep/1970:12:00:00 +0600")];
+            static TCHAR m_HTTPTime[sizeof("Mon, 28 Sep 1970 06:00:00 GMT")];
+
+        public:
+
+            static void Update();
+            /// Refreshes LogTime() only, without localtime_r() and strftime(): safe to call from a signal handler
+            static void SigSafeUpdate();
+
+            static time_t Seconds() { return m_Seconds; }
+            static u_int MSeconds() { return m_MSeconds; }
+
+            /// "%Y/%m/%d %H:%M:%S", local time
+            static LPCTSTR LogTime() { return m_LogTime; }
+            /// "%d/%b/%Y:%T %z", local time
+            static LPCTSTR AccessTime() { return m_AccessTime; }
+            /// RFC 7231 IMF-fixdate
+            static LPCTSTR HTTPTime() { return m_HTTPTime; }
+
+        };
+        //--------------------------------------------------------------------------------------------------------------
+
+        struct CLogTarget {
+            int Handle;
+            u_int Level;
+        };
+
+        typedef std::vector<CLogTarget> CLogTargets;
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Call site of a log message: the return address of the CLog entry point and a hash of the format text.
+        /// The address tells apart sites sharing one format ("%s"), the hash - messages passed on by one forwarder.
+        /// The text is hashed, not the pointer: a format may be a temporary (e.what())
+        struct CLogSite {
+            const void *Address;
+            size_t Format;
+
+            bool operator==(const CLogSite &Value) const {
+                return Address == Value.Address && Format == Value.Format;
+            }
+        };
+
+        struct CLogSiteHash {
+            size_t operator()(const CLogSite &Value) const {
+                return std::hash<const void *>()(Value.Address) ^ (Value.Format << 1);
+            }
+        };
+
+        /// Token bucket of one call site
+        struct CLogBucket {
+            double Tokens;
+            uint64_t Updated;
+            time_t Reported;
+            u_int Suppressed;
+            u_int Level;
+            /// Head of the format for the "suppressed" report
+            char Format[LOG_BUCKET_FORMAT + 1];
+        };
+
+        typedef std::unordered_map<CLogSite, CLogBucket, CLogSiteHash> CLogBuckets;
+
+        //--------------------------------------------------------------------------------------------------------------
+
         //-- CLogFile --------------------------------------------------------------------------------------------------
 
         //--------------------------------------------------------------------------------------------------------------
@@ -161,26 +249,108 @@ namespace Apostol {
         class CLogFile: public CFile, public CCollectionItem {
         private:
 
+            CLog *m_pLog;
+
             u_int m_uLevel;
 
             CLogType m_LogType;
 
+            void SetLevel(u_int Value);
+            void SetLogType(CLogType Value);
+
         public:
 
             explicit CLogFile(CLog *ALog, const CString &FileName);
 
             ~CLogFile() override = default;
 
+            bool Reopen(uid_t AUser = (uid_t) -1, gid_t AGroup = (gid_t) -1);
+
             u_int Level() const { return m_uLevel; }
-            void Level(u_int Value) { m_uLevel = Value; };
+            void Level(u_int Value) { SetLevel(Value); };
 
             CLogType LogType() { return m_LogType; }
-            void LogType(CLogType Value) { m_LogType = Value; };
+            void LogType(CLogType Value) { SetLogType(Value); };
 
         }; // class CLogFile
 
         //--------------------------------------------------------------------------------------------------------------
 
+        //-- CLogRing --------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        struct CLogRingRecord {
+            size_t Offset;
+            uint32_t Length;
+            CLogType LogType;
+            u_int Level;
+        };
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Shared memory rings, one per child process: the child is the only producer, the master the only consumer.
+        /// The area is mapped by the master before fork() and inherited by the children.
+        class CLogRing {
+        private:
+
+            struct CHeader {
+                std::atomic<time_t> Heartbeat;
+                uint32_t Count;
+                uint32_t Size;
+            };
+
+            struct alignas(64) CRing {
+                std::atomic<pid_t> Owner;
+                std::atomic<uint64_t> Head;
+                std::atomic<uint64_t> Tail;
+            };
+
+            struct CRecord {
+                uint32_t Length;
+                uint16_t LogType;
+                uint16_t Level;
+            };
+
+            CHeader *m_pHeader;
+            size_t m_AreaSize;
+
+            int m_Slot;
+
+            /// Set while a signal handler runs: its records go straight to the files
+            volatile sig_atomic_t m_Signal;
+            /// Set while Write() fills a record, a Write() from an interrupting handler must not interleave with it
+            volatile sig_atomic_t m_Writing;
+
+            CRing *GetRing(int Index) const;
+            char *GetData(int Index) const;
+
+            void CopyTo(int Index, uint64_t Pos, const void *Source, size_t Size) const;
+            void CopyFrom(int Index, uint64_t Pos, void *Dest, size_t Size) const;
+
+        public:
+
+            CLogRing();
+
+            ~CLogRing();
+
+            void Create(int Count, size_t Size);
+            void Destroy();
+
+            bool Attach();
+
+            bool Write(CLogType ALogType, u_int ALevel, LPCSTR ABuffer, size_t ASize);
+            bool Read(std::vector<char> &Batch, std::vector<CLogRingRecord> &Records, u_int &Corrupted);
+
+            bool Signal() const { return m_Signal != 0; }
+            void Signal(bool Value) { m_Signal = Value ? 1 : 0; }
+
+            bool Active() const { return m_pHeader != nullptr; }
+            bool Attached() const { return m_pHeader != nullptr && m_Slot != -1; }
+
+        };
+
+        //--------------------------------------------------------------------------------------------------------------
+
         //-- CLogComponent ---------------------------------------------------------------------------------------------
 
         //--------------------------------------------------------------------------------------------------------------
@@ -203,15 +373,47 @@ namespace Apostol {
 
             u_int       m_uLevel;
             u_int       m_uDebugLevel;
+
+            /// Open handles of the log files by type, the hot path walks these instead of the collection
+            CLogTargets m_Targets[ltDebug + 1];
+
+            /// The highest level accepted by any file of the type, for the early exit in ErrorCore
+            u_int       m_uMaxLevel[ltDebug + 1];
+
             int         m_CurrentIndex;
             bool        m_fUseStdErr;
             time_t      m_DiskFullTime;
+            time_t      m_RotateTime;
+
+            /// Owner of the files created by Reopen(), -1 - leave as is
+            uid_t       m_OwnerUser;
+            gid_t       m_OwnerGroup;
+
+            /// Messages per call site and interval (seconds) of each log type, 0 - no limit
+            u_int       m_uLimit[ltDebug + 1];
+            u_int       m_uLimitInterval[ltDebug + 1];
+
+            CLogBuckets m_Buckets[ltDebug + 1];
+
+            bool Admit(u_int ALevel, const void *ASite, LPCSTR AFormat, CLogType ALogType);
+
+            /// Access log lines waiting for FlushAccess(), a ring of LOG_ACCESS_BUFFER bytes
+            char        m_AccessBuffer[LOG_ACCESS_BUFFER];
+            size_t      m_AccessHead;
+            size_t      m_AccessLength;
+
+            void AccessWrite(LPCSTR ABuffer, size_t ASize);
+
+            CLogRing    m_Ring;
+
+            std::vector<char> m_RingBatch;
+            std::vector<CLogRingRecord> m_RingRecords;
 
         protected:
 
             static char *StrError(int AError, char *AStr, size_t ASize);
             static char *ErrNo(char *ADest, char *ALast, int AError);
-            void ErrorCore(u_int ALevel, int AError, LPCSTR AFormat, CLogType ALogType, va_list args);
+            void ErrorCore(u_int ALevel, int AError, const void *ASite, LPCSTR AFormat, CLogType ALogType, va_list args);
 
             void SetLevel(u_int Value);
             void SetDebugLevel(u_int Value);
@@ -229,7 +431,7 @@ namespace Apostol {
 
             inline static void DestroyLog() { delete GLog; };
 
-            ~CLog() override = default;
+            ~CLog() override;
 
             CLogFile *AddLogFile(const CString &FileName, u_int ALevel = APP_LOG_STDERR);
 
@@ -251,6 +453,22 @@ namespace Apostol {
             void Access(LPCSTR AFormat, ...);
             void Access(LPCSTR AFormat, va_list args);
 
+            void FlushAccess();
+
+            void FlushRing();
+
+            void Reopen();
+            bool Rotate(size_t ASize, u_int ACount);
+
+            void Owner(uid_t AUser, gid_t AGroup) { m_OwnerUser = AUser; m_OwnerGroup = AGroup; };
+
+            void SetLimit(CLogType ALogType, u_int AMessages, u_int AInterval);
+            /// Reports suppressed messages and drops buckets idle for a whole interval
+            void FlushSuppressed();
+
+            CLogRing &Ring() { return m_Ring; };
+            const CLogRing &Ring() const { return m_Ring; };
+
             void Stream(LPCSTR AFormat, ...);
             void Stream(LPCSTR AFormat, va_list args);
 
@@ -271,6 +489,10 @@ namespace Apostol {
 
             void RedirectStdErr();
 
+            void UpdateTargets();
+
+            const CLogTargets &Targets(CLogType ALogType) const { return m_Targets[ALogType]; }
+
             int CurrentIndex() const { return m_CurrentIndex; }
             void CurrentIndex(int Index) { SetCurrentIndex(Index); };
 
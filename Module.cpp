@@ -32,17 +32,1024 @@ namespace Apostol {
     namespace Module {
 
         LPCTSTR StrWebTime(time_t Time, LPTSTR lpszBuffer, size_t Size) {
-            struct tm *gmt;
+            if (Time == CCachedTime::Seconds()) {
+                return ::strlen(CCachedTime::HTTPTime()) < Size ? ::strcpy(lpszBuffer, CCachedTime::HTTPTime()) : nullptr;
+            }
 
-            gmt = gmtime(&Time);
+            struct tm gmt = {};
 
-            if ((gmt != nullptr) && (strftime(lpszBuffer, Size, "%a, %d %b %Y %T %Z", gmt) != 0)) {
+            if ((gmtime_r(&Time, &gmt) != nullptr) && (strftime(lpszBuffer, Size, "%a, %d %b %Y %T %Z", &gmt) != 0)) {
                 return lpszBuffer;
             }
 
             return nullptr;
         }
+        //--------------------------------------------------------------------------------------------------------------
+
+        time_t WebTimeToTime(LPCTSTR lpszTime) {
+            struct tm gmt = {};
+
+            if (lpszTime == nullptr || strptime(lpszTime, "%a, %d %b %Y %T", &gmt) == nullptr)
+                return (time_t) -1;
+
+            return timegm(&gmt);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CMethodType StrToMethodType(LPCTSTR lpszMethod) {
+            if (lpszMethod == nullptr)
+                return mtUnknown;
+
+            switch (lpszMethod[0]) {
+                case 'G':
+                    return strcmp(lpszMethod, "GET") == 0 ? mtGet : mtUnknown;
+                case 'H':
+                    return strcmp(lpszMethod, "HEAD") == 0 ? mtHead : mtUnknown;
+                case 'P':
+                    if (strcmp(lpszMethod, "POST") == 0)
+                        return mtPost;
+                    if (strcmp(lpszMethod, "PUT") == 0)
+                        return mtPut;
+                    return strcmp(lpszMethod, "PATCH") == 0 ? mtPatch : mtUnknown;
+                case 'D':
+                    return strcmp(lpszMethod, "DELETE") == 0 ? mtDelete : mtUnknown;
+                case 'O':
+                    return strcmp(lpszMethod, "OPTIONS") == 0 ? mtOptions : mtUnknown;
+                case 'T':
+                    return strcmp(lpszMethod, "TRACE") == 0 ? mtTrace : mtUnknown;
+                case 'C':
+                    return strcmp(lpszMethod, "CONNECT") == 0 ? mtConnect : mtUnknown;
+                default:
+                    return mtUnknown;
+            }
+        }
+#ifndef APOSTOL_SERVER_TYPE_TCP
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CRouteTable -----------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        CRouteTable::CRouteTable(): m_AnyHost(-1) {
+
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CRouteTable::Clear() {
+            m_Nodes.clear();
+            m_Hosts.clear();
+            m_AnyHost = -1;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        int CRouteTable::AddNode(TCHAR Char) {
+            m_Nodes.push_back({Char, -1, -1, {}});
+            return (int) m_Nodes.size() - 1;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        int CRouteTable::FindChild(int Node, TCHAR Char) const {
+            int Index = m_Nodes[Node].Child;
+            while (Index != -1 && m_Nodes[Index].Char != Char) {
+                Index = m_Nodes[Index].Next;
+            }
+            return Index;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        int CRouteTable::GetRoot(const CString &Host) {
+            if (Host.IsEmpty() || Host == _T("*")) {
+                if (m_AnyHost == -1)
+                    m_AnyHost = AddNode('\0');
+                return m_AnyHost;
+            }
+
+            for (const auto &Item : m_Hosts) {
+                if (Item.Host == Host)
+                    return Item.Root;
+            }
+
+            const auto Root = AddNode('\0');
+            m_Hosts.push_back({Host, Root});
+
+            return Root;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CRouteTable::Add(const CString &Host, const CString &Path, int Module) {
+            size_t Length = Path.Length();
+
+            // "/api/*" and "/api/" are the same prefix
+            if (Length > 0 && Path[Length - 1] == '*')
+                Length--;
+
+            int Node = GetRoot(Host);
+
+            for (size_t i = 0; i < Length; ++i) {
+                const TCHAR Char = Path[i];
+                int Child = FindChild(Node, Char);
+                if (Child == -1) {
+                    Child = AddNode(Char);
+                    m_Nodes[Child].Next = m_Nodes[Node].Child;
+                    m_Nodes[Node].Child = Child;
+                }
+                Node = Child;
+            }
+
+            auto &Modules = m_Nodes[Node].Modules;
+            for (const auto Index : Modules) {
+                if (Index == Module)
+                    return;
+            }
+
+            Modules.push_back(Module);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CRouteTable::MatchRoot(int Root, LPCTSTR lpszPath, std::vector<uint8_t> &Marks) const {
+            int Node = Root;
+            LPCTSTR P = lpszPath;
+
+            while (Node != -1) {
+                const auto &Item = m_Nodes[Node];
+
+                // A prefix matches on the segment boundary only: "/api" serves "/api" and "/api/v1", not "/apiv1"
+                if (!Item.Modules.empty() && (Item.Char == '/' || *P == '\0' || *P == '/')) {
+                    for (const auto Index : Item.Modules) {
+                        Marks[Index] = 1;
+                    }
+                }
+
+                if (*P == '\0')
+                    break;
+
+                Node = FindChild(Node, *P++);
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CRouteTable::Match(LPCTSTR lpszHost, LPCTSTR lpszPath, std::vector<uint8_t> &Marks) const {
+            if (m_AnyHost != -1)
+                MatchRoot(m_AnyHost, lpszPath, Marks);
+
+            if (lpszHost == nullptr)
+                return;
+
+            for (const auto &Item : m_Hosts) {
+                const auto Length = Item.Host.Length();
+                // Compare the host name without the port
+                if (strncmp(Item.Host.c_str(), lpszHost, Length) == 0 && (lpszHost[Length] == '\0' || lpszHost[Length] == ':')) {
+                    MatchRoot(Item.Root, lpszPath, Marks);
+                    break;
+                }
+            }
+        }
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CLocationMatcher ------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        CLocationMatcher::CLocationMatcher() {
+            Clear();
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CLocationMatcher::CLocationMatcher(const CStringList &List): CLocationMatcher() {
+            Compile(List);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLocationMatcher::Clear() {
+            m_Nodes.clear();
+            AddNode(CString());
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        int CLocationMatcher::AddNode(const CString &Segment) {
+            m_Nodes.push_back({Segment, -1, -1, false, -1});
+            return (int) m_Nodes.size() - 1;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        int CLocationMatcher::FindChild(int Node, LPCTSTR lpszSegment, size_t Length) const {
+            int Index = m_Nodes[Node].Child;
+            while (Index != -1) {
+                const auto &Segment = m_Nodes[Index].Segment;
+                if (Segment.Length() == Length && strncmp(Segment.c_str(), lpszSegment, Length) == 0)
+                    break;
+                Index = m_Nodes[Index].Next;
+            }
+            return Index;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        size_t CLocationMatcher::SegmentCount(LPCTSTR lpszPath) {
+            if (lpszPath == nullptr || *lpszPath == '\0')
+                return 0;
+
+            size_t Count = 1;
+            for (LPCTSTR P = lpszPath; *P != '\0'; P++) {
+                if (*P == '/')
+                    Count++;
+            }
+
+            return Count;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLocationMatcher::Add(const CString &Pattern) {
+            const auto Count = (int) SegmentCount(Pattern.c_str());
+
+            int Node = 0;
+            int Depth = 0;
+
+            LPCTSTR P = Pattern.c_str();
+
+            while (Depth < Count) {
+                LPCTSTR End = strchr(P, '/');
+                const size_t Length = End == nullptr ? strlen(P) : End - P;
+
+                // "*" accepts the rest of the path as long as it has at least as many segments as the pattern
+                if (Length == 1 && *P == '*') {
+                    auto &Wildcard = m_Nodes[Node].Wildcard;
+                    if (Wildcard == -1 || Count < Wildcard)
+                        Wildcard = Count;
+                    return;
+                }
+
+                int Child = FindChild(Node, P, Length);
+                if (Child == -1) {
+                    Child = AddNode(Pattern.SubString(P - Pattern.c_str(), Length));
+                    m_Nodes[Child].Next = m_Nodes[Node].Child;
+                    m_Nodes[Node].Child = Child;
+                }
+
+                Node = Child;
+                Depth++;
+
+                P += Length;
+                if (*P == '/')
+                    P++;
+            }
+
+            m_Nodes[Node].Terminal = true;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CLocationMatcher::Compile(const CStringList &List) {
+            Clear();
+            for (int i = 0; i < List.Count(); i++) {
+                Add(List[i]);
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CLocationMatcher::Match(LPCTSTR lpszPath) const {
+            const auto Count = (int) SegmentCount(lpszPath);
+
+            int Node = 0;
+            int Depth = 0;
+
+            LPCTSTR P = lpszPath;
+
+            while (Node != -1) {
+                const auto &Item = m_Nodes[Node];
+
+                if (Item.Wildcard != -1 && Item.Wildcard <= Count)
+                    return true;
+
+                if (Depth == Count)
+                    return Item.Terminal;
+
+                LPCTSTR End = strchr(P, '/');
+                const size_t Length = End == nullptr ? strlen(P) : End - P;
+
+                Node = FindChild(Node, P, Length);
+                Depth++;
+
+                P += Length;
+                if (*P == '/')
+                    P++;
+            }
+
+            return false;
+        }
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CFileCache ------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        CFileCache::CFileCache(): m_Pid(-1), m_Inotify(-1), m_Updated(0) {
+
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CFileCache::~CFileCache() {
+            Close();
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CFileCache::Open() {
+            // The descriptor must not be shared with the parent after fork()
+            m_Pid = getpid();
+            m_Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (m_Inotify == -1)
+                GLog->Error(APP_LOG_WARN, errno, _T("inotify_init1() failed, file cache disabled"));
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CFileCache::Close() {
+            if (m_Inotify != -1) {
+                ::close(m_Inotify);
+                m_Inotify = -1;
+            }
+
+            m_Files.clear();
+            m_Index.clear();
+            m_Watches.clear();
+            m_Directories.clear();
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CFileCache::Clear() {
+            m_Files.clear();
+            m_Index.clear();
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CFileCache::Erase(const std::string &Path) {
+            const auto it = m_Index.find(Path);
+            if (it != m_Index.end()) {
+                m_Files.erase(it->second);
+                m_Index.erase(it);
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CFileCache::FileStat(LPCTSTR lpszPath, CFileInfo &Info) {
+            struct stat st {};
+
+            Info = CFileInfo();
+
+            if (::stat(lpszPath, &st) == 0) {
+                Info.Exists = true;
+                Info.Directory = S_ISDIR(st.st_mode);
+                Info.Inode = st.st_ino;
+                Info.Size = st.st_size;
+                Info.Modified = st.st_mtime;
+
+                if (!Info.Directory) {
+                    TCHAR szExt[MAX_BUFFER_SIZE + 1] = {0};
+                    Info.ContentType = Mapping::ExtToType(ExtractFileExt(szExt, lpszPath));
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CFileCache::Watch(const std::string &Path) {
+            const auto Pos = Path.find_last_of('/', Path.size() > 1 ? Path.size() - 2 : 0);
+            if (Pos == std::string::npos)
+                return false;
+
+            const auto Directory = Path.substr(0, Pos == 0 ? 1 : Pos);
+
+            if (m_Directories.find(Directory) != m_Directories.end())
+                return true;
+
+            const auto wd = inotify_add_watch(m_Inotify, Directory.c_str(),
+                IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+                IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+
+            // Not watchable (e.g. missing parent directory): the lookup is not cached
+            if (wd == -1)
+                return false;
+
+            m_Watches[wd] = Directory;
+            m_Directories[Directory] = wd;
+
+            return true;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CFileCache::Invalidate(const std::string &Directory, LPCTSTR lpszName) {
+            std::string Path(Directory);
+
+            if (Path.back() != '/')
+                Path += '/';
+            Path += lpszName;
+
+            Erase(Path);
+            Erase(Path + '/');
+
+            // A replaced directory invalidates everything below it
+            InvalidateDirectory(Path);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CFileCache::InvalidateDirectory(const std::string &Directory) {
+            const auto Prefix = Directory.back() == '/' ? Directory : Directory + '/';
+
+            for (auto it = m_Files.begin(); it != m_Files.end();) {
+                if (it->Path.compare(0, Prefix.size(), Prefix) == 0) {
+                    m_Index.erase(it->Path);
+                    it = m_Files.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CFileCache::Update() {
+            if (m_Inotify == -1)
+                return;
+
+            if (m_Pid != getpid()) {
+                Close();
+                Open();
+                return;
+            }
+
+            m_Updated = time(nullptr);
+
+            char Buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+            ssize_t Size;
+            while ((Size = ::read(m_Inotify, Buffer, sizeof(Buffer))) > 0) {
+                for (char *P = Buffer; P < Buffer + Size; ) {
+                    const auto pEvent = (const struct inotify_event *) P;
+
+                    if (pEvent->mask & IN_Q_OVERFLOW) {
+                        Clear();
+                    } else {
+                        const auto it = m_Watches.find(pEvent->wd);
+                        if (it != m_Watches.end()) {
+                            if (pEvent->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                                InvalidateDirectory(it->second);
+
+                                // The directory may already be watched again under a new descriptor
+                                const auto Directory = m_Directories.find(it->second);
+                                if (Directory != m_Directories.end() && Directory->second == pEvent->wd)
+                                    m_Directories.erase(Directory);
+
+                                if (pEvent->mask & IN_IGNORED) {
+                                    m_Watches.erase(it);
+                                } else {
+                                    inotify_rm_watch(m_Inotify, pEvent->wd);
+                                }
+                            } else if (pEvent->len > 0) {
+                                Invalidate(it->second, pEvent->name);
+                            }
+                        }
+                    }
+
+                    P += sizeof(struct inotify_event) + pEvent->len;
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        const CFileInfo &CFileCache::Stat(LPCTSTR lpszPath) {
+            const auto MaxSize = GConfig->FileCacheSize();
+
+            if (MaxSize == 0) {
+                FileStat(lpszPath, m_Info);
+                return m_Info;
+            }
+
+            if (m_Pid == -1)
+                Open();
+
+            // Events are drained on the process timer; this bounds the staleness when it ticks late
+            if (m_Updated != time(nullptr))
+                Update();
+
+            if (m_Inotify == -1) {
+                FileStat(lpszPath, m_Info);
+                return m_Info;
+            }
+
+            std::string Path(lpszPath);
+
+            const auto it = m_Index.find(Path);
+            if (it != m_Index.end()) {
+                m_Files.splice(m_Files.begin(), m_Files, it->second);
+                return it->second->Info;
+            }
+
+            FileStat(lpszPath, m_Info);
+
+            if (!Watch(Path))
+                return m_Info;
+
+            while (!m_Files.empty() && m_Files.size() >= MaxSize) {
+                m_Index.erase(m_Files.back().Path);
+                m_Files.pop_back();
+            }
+
+            m_Files.push_front({Path, m_Info});
+            m_Index[Path] = m_Files.begin();
+
+            return m_Files.front().Info;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CMemoryCache ----------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        CMemoryCache::CMemoryCache(): m_Size(0) {
+
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CMemoryCache::Clear() {
+            m_Index.clear();
+            m_Files.clear();
+            m_Size = 0;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        const CString *CMemoryCache::Find(const CString &Path, const CFileInfo &Info) {
+            const auto it = m_Index.find(Path.c_str());
+            if (it == m_Index.end())
+                return nullptr;
+
+            const auto Item = it->second;
+
+            // Info comes from the stat cache, so a changed file is noticed without a syscall
+            if (Item->Inode != Info.Inode || Item->Modified != Info.Modified || (off_t) Item->Content.Length() != Info.Size) {
+                m_Size -= Item->Content.Length();
+                m_Files.erase(Item);
+                m_Index.erase(it);
+                return nullptr;
+            }
+
+            m_Files.splice(m_Files.begin(), m_Files, Item);
+
+            return &Item->Content;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        const CString *CMemoryCache::Add(const CString &Path, const CFileInfo &Info, CString &Content) {
+            const auto MaxSize = GConfig->MemoryCacheSize();
+            const auto Length = Content.Length();
+
+            if (Length > MaxSize)
+                return nullptr;
+
+            std::string Key(Path.c_str());
+
+            const auto it = m_Index.find(Key);
+            if (it != m_Index.end()) {
+                m_Size -= it->second->Content.Length();
+                m_Files.erase(it->second);
+                m_Index.erase(it);
+            }
+
+            while (!m_Files.empty() && m_Size + Length > MaxSize) {
+                const auto &Last = m_Files.back();
+                m_Size -= Last.Content.Length();
+                m_Index.erase(Last.Path);
+                m_Files.pop_back();
+            }
+
+            m_Files.push_front({Key, Info.Inode, Info.Modified, CString()});
+
+            auto &Item = m_Files.front();
+            std::swap(Item.Content, Content);
+
+            m_Index[Key] = m_Files.begin();
+            m_Size += Length;
+
+            return &Item.Content;
+        }
+#ifdef WITH_ZLIB
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CGzipCache ------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        CGzipCache::CGzipCache(): m_Source(-1), m_Target(nullptr) {
+
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CGzipCache::~CGzipCache() {
+            Finish(false);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CString CGzipCache::CacheFile(const CString &Resource, time_t Modified) {
+            // FNV-1a of the path, the mtime makes a changed file miss the old entry
+            uint64_t Hash = 14695981039346656037ULL;
+            for (size_t i = 0; i < Resource.Length(); ++i) {
+                Hash ^= (unsigned char) Resource[i];
+                Hash *= 1099511628211ULL;
+            }
+
+            CString Result;
+            Result.Format("%sgzip/%016llx-%llx.gz", GConfig->CachePrefix().c_str(), (unsigned long long) Hash, (unsigned long long) Modified);
+
+            return Result;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CGzipCache::Enqueue(const CString &Source, const CString &Target) {
+            std::string Key(Target.c_str());
+
+            if (m_Pending.find(Key) != m_Pending.end())
+                return;
+
+            m_Pending.insert(Key);
+            m_Queue.push_back({Source.c_str(), Key});
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CGzipCache::Start() {
+            m_Job = m_Queue.front();
+            m_Queue.pop_front();
+
+            struct stat st = {};
+
+            // Another worker may have compressed it since the request was queued
+            if (::stat(m_Job.Target.c_str(), &st) == 0) {
+                Finish(false);
+                return false;
+            }
+
+            m_Source = ::open(m_Job.Source.c_str(), O_RDONLY | O_CLOEXEC);
+            if (m_Source == -1) {
+                Finish(false);
+                return false;
+            }
+
+            // One temporary name per target: O_EXCL lets only one worker compress it at a time
+            const auto Temp = m_Job.Target + ".tmp";
+
+            auto fd = ::open(Temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+            if (fd == -1 && errno == EEXIST) {
+                // Left behind by a worker that died midway: a live one touches it on every tick
+                if (::stat(Temp.c_str(), &st) == 0 && time(nullptr) - st.st_mtime > APOSTOL_GZIP_STALE_TEMP) {
+                    ::unlink(Temp.c_str());
+                    fd = ::open(Temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+                }
+            }
+
+            if (fd == -1) {
+                if (errno != EEXIST)
+                    GLog->Error(APP_LOG_WARN, errno, _T("open \"%s\" failed"), Temp.c_str());
+                Finish(false);
+                return false;
+            }
+
+            m_Temp = Temp;
+
+            fchmod(fd, 0644);
+
+            m_Target = gzdopen(fd, "wb6");
+            if (m_Target == nullptr) {
+                ::close(fd);
+                Finish(false);
+                return false;
+            }
+
+            return true;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CGzipCache::Finish(bool Success) {
+            if (m_Source != -1) {
+                ::close(m_Source);
+                m_Source = -1;
+            }
+
+            if (m_Target != nullptr) {
+                if (gzclose(m_Target) != Z_OK)
+                    Success = false;
+                m_Target = nullptr;
+            }
+
+            if (!m_Temp.empty()) {
+                // Readers see either no file or the complete one
+                if (!Success || ::rename(m_Temp.c_str(), m_Job.Target.c_str()) == -1) {
+                    ::unlink(m_Temp.c_str());
+                } else {
+                    RemoveStale(m_Job.Target);
+                }
+                m_Temp.clear();
+            }
+
+            m_Pending.erase(m_Job.Target);
+            m_Job = CJob();
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CGzipCache::RemoveStale(const std::string &Target) {
+            // "<dir>/<hash>-<mtime>.gz": the copies of older versions of the file share "<hash>-"
+            const auto Slash = Target.rfind('/');
+            const auto Dash = Target.rfind('-');
+
+            if (Slash == std::string::npos || Dash == std::string::npos || Dash < Slash)
+                return;
+
+            const auto Directory = Target.substr(0, Slash);
+            const auto Name = Target.substr(Slash + 1);
+            const auto Prefix = Target.substr(Slash + 1, Dash - Slash);
+
+            const auto pDir = ::opendir(Directory.c_str());
+            if (pDir == nullptr)
+                return;
+
+            struct dirent *pEntry;
+            while ((pEntry = ::readdir(pDir)) != nullptr) {
+                const auto Length = strlen(pEntry->d_name);
+
+                // Temporary files belong to whoever is writing them
+                if (Length <= 3 || strcmp(pEntry->d_name + Length - 3, ".gz") != 0)
+                    continue;
+
+                if (strncmp(pEntry->d_name, Prefix.c_str(), Prefix.size()) != 0 || Name == pEntry->d_name)
+                    continue;
+
+                ::unlinkat(dirfd(pDir), pEntry->d_name, 0);
+            }
+
+            ::closedir(pDir);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CGzipCache::Process(size_t Budget) {
+            char Buffer[64 * 1024];
+
+            while (Budget > 0) {
+                if (m_Target == nullptr) {
+                    if (m_Queue.empty())
+                        break;
+                    if (!Start())
+                        continue;
+                }
+
+                const auto Size = ::read(m_Source, Buffer, sizeof(Buffer));
+
+                if (Size == 0) {
+                    Finish(true);
+                } else if (Size < 0 || gzwrite(m_Target, Buffer, (unsigned) Size) != Size) {
+                    Finish(false);
+                } else {
+                    Budget = (size_t) Size < Budget ? Budget - Size : 0;
+                }
+            }
+        }
+#endif
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CMetrics --------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        CMetrics::CMetrics(): m_pSlots(nullptr), m_Count(0), m_pSlot(nullptr) {
+            std::fill(m_Index, m_Index + APOSTOL_METRICS_MODULES, APOSTOL_METRICS_MODULES);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CMetrics::~CMetrics() {
+            Destroy();
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CMetrics::Create(int Count) {
+            Destroy();
+
+            const auto Size = sizeof(CSlot) * Count;
+
+            const auto pArea = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (pArea == MAP_FAILED)
+                throw EOSError(errno, _T("mmap(%lu) for metrics failed"), (unsigned long) Size);
+
+            m_pSlots = (CSlot *) pArea;
+            m_Count = Count;
+
+            for (int i = 0; i < Count; ++i) {
+                new (m_pSlots + i) CSlot();
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
 
+        void CMetrics::Destroy() {
+            if (m_pSlots != nullptr) {
+                munmap(m_pSlots, sizeof(CSlot) * m_Count);
+                m_pSlots = nullptr;
+                m_Count = 0;
+            }
+            m_pSlot = nullptr;
+            m_Handlers.clear();
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CMetrics::Attach(const CModuleManager &Manager) {
+            if (m_pSlots == nullptr)
+                return false;
+
+            const auto pid = getpid();
+
+            for (int i = 0; i < m_Count; ++i) {
+                auto &Slot = m_pSlots[i];
+
+                pid_t Current = Slot.Owner.load();
+                // Counters of an exited process are taken over, so the totals never go back. They stay with the
+                // module names they were counted for: the new owner may run a different set of modules
+                if (Current == 0 || (Current != pid && kill(Current, 0) == -1 && errno == ESRCH)) {
+                    if (Slot.Owner.compare_exchange_strong(Current, pid)) {
+                        const auto Count = Min(Manager.ModuleCount(), APOSTOL_METRICS_MODULES);
+
+                        for (int m = 0; m < Count; ++m) {
+                            const auto &caName = Manager.Modules(m)->ModuleName();
+
+                            int Index = 0;
+                            while (Index < (int) Slot.Modules && ::strncmp(caName.c_str(), Slot.Names[Index], APOSTOL_METRICS_NAME - 1) != 0)
+                                Index++;
+
+                            if (Index == (int) Slot.Modules && Index < APOSTOL_METRICS_MODULES) {
+                                auto &Data = Slot.Data[Index];
+
+                                for (auto &Requests : Data.Requests)
+                                    for (auto &Value : Requests)
+                                        Value.store(0, std::memory_order_relaxed);
+
+                                for (auto &Value : Data.Buckets)
+                                    Value.store(0, std::memory_order_relaxed);
+
+                                Data.Sum.store(0, std::memory_order_relaxed);
+
+                                ::strncpy(Slot.Names[Index], caName.c_str(), APOSTOL_METRICS_NAME - 1);
+                                Slot.Names[Index][APOSTOL_METRICS_NAME - 1] = '\0';
+
+                                Slot.Modules = Index + 1;
+                            }
+
+                            // No room left: the module is counted as "none"
+                            m_Index[m] = Index < (int) Slot.Modules ? Index : APOSTOL_METRICS_MODULES;
+                        }
+
+                        for (int m = Count; m < APOSTOL_METRICS_MODULES; ++m)
+                            m_Index[m] = APOSTOL_METRICS_MODULES;
+
+                        m_pSlot = &Slot;
+
+                        return true;
+                    }
+                }
+            }
+
+            m_pSlot = nullptr;
+            return false;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CMetrics::Bind(CTCPConnection *AConnection, int Module) {
+            if (m_pSlot == nullptr)
+                return;
+
+            m_Handlers[AConnection] = Module;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CMetrics::Unbind(CTCPConnection *AConnection) {
+            // A connection closed without a reply leaves its entry behind
+            m_Handlers.erase(AConnection);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CMetrics::Record(CHTTPServerConnection *AConnection) {
+            if (m_pSlot == nullptr)
+                return;
+
+            const auto &caRequest = AConnection->Request();
+            const auto &caReply = AConnection->Reply();
+
+            const auto Method = StrToMethodType(caRequest.Method.c_str());
+            if (Method == mtUnknown)
+                return;
+
+            int Module = APOSTOL_METRICS_MODULES;
+
+            const auto it = m_Handlers.find(AConnection);
+            if (it != m_Handlers.end()) {
+                if (it->second < APOSTOL_METRICS_MODULES)
+                    Module = m_Index[it->second];
+                m_Handlers.erase(it);
+            }
+
+            const auto Status = (int) caReply.Status / 100;
+            const auto Class = Status < 1 ? 0 : Min(Status, APOSTOL_METRICS_CLASSES) - 1;
+
+            const auto Latency = (Now() - AConnection->Clock()) * MSecsPerDay * 1000;
+            const auto Micro = Latency > 0 ? (uint64_t) Latency : 0;
+
+            int Bucket = 0;
+            while (Bucket < APOSTOL_METRICS_BUCKETS && (1ull << Bucket) < Micro)
+                Bucket++;
+
+            // One writer per slot: relaxed load and store, no locked instructions
+            auto &Data = m_pSlot->Data[Module];
+
+            auto &Requests = Data.Requests[Method][Class];
+            Requests.store(Requests.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            Data.Buckets[Bucket].store(Data.Buckets[Bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            Data.Sum.store(Data.Sum.load(std::memory_order_relaxed) + Micro, std::memory_order_relaxed);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CMetrics::Render(CString &Text) const {
+            static LPCTSTR Methods[] = { _T("OPTIONS"), _T("GET"), _T("HEAD"), _T("POST"), _T("PUT"), _T("PATCH"),
+                                         _T("DELETE"), _T("TRACE"), _T("CONNECT") };
+
+            struct CTotals {
+                uint64_t Requests[APOSTOL_METHOD_COUNT][APOSTOL_METRICS_CLASSES];
+                uint64_t Buckets[APOSTOL_METRICS_BUCKETS + 1];
+                uint64_t Sum;
+            };
+
+            std::map<std::string, CTotals> Totals;
+
+            for (int i = 0; i < m_Count; ++i) {
+                const auto &Slot = m_pSlots[i];
+
+                if (Slot.Owner.load() == 0)
+                    continue;
+
+                for (int m = 0; m <= APOSTOL_METRICS_MODULES; ++m) {
+                    if (m < APOSTOL_METRICS_MODULES && m >= (int) Slot.Modules)
+                        continue;
+
+                    auto &Total = Totals[m == APOSTOL_METRICS_MODULES ? std::string("none") : std::string(Slot.Names[m])];
+                    const auto &Data = Slot.Data[m];
+
+                    for (int r = 0; r < APOSTOL_METHOD_COUNT; ++r)
+                        for (int c = 0; c < APOSTOL_METRICS_CLASSES; ++c)
+                            Total.Requests[r][c] += Data.Requests[r][c].load(std::memory_order_relaxed);
+
+                    for (int b = 0; b <= APOSTOL_METRICS_BUCKETS; ++b)
+                        Total.Buckets[b] += Data.Buckets[b].load(std::memory_order_relaxed);
+
+                    Total.Sum += Data.Sum.load(std::memory_order_relaxed);
+                }
+            }
+
+            TCHAR szLine[MAX_BUFFER_SIZE + 1];
+
+            Text << "# HELP apostol_requests_total Requests by module, method and status class.\n";
+            Text << "# TYPE apostol_requests_total counter\n";
+
+            for (const auto &Total : Totals) {
+                for (int r = 0; r < APOSTOL_METHOD_COUNT; ++r) {
+                    for (int c = 0; c < APOSTOL_METRICS_CLASSES; ++c) {
+                        if (Total.second.Requests[r][c] == 0)
+                            continue;
+
+                        ::snprintf(szLine, sizeof(szLine), "apostol_requests_total{module=\"%s\",method=\"%s\",code=\"%dxx\"} %llu\n",
+                                   Total.first.c_str(), Methods[r], c + 1, (unsigned long long) Total.second.Requests[r][c]);
+                        Text << szLine;
+                    }
+                }
+            }
+
+            Text << "# HELP apostol_request_duration_seconds Request latency by module.\n";
+            Text << "# TYPE apostol_request_duration_seconds histogram\n";
+
+            for (const auto &Total : Totals) {
+                uint64_t Count = 0;
+
+                for (int b = 0; b <= APOSTOL_METRICS_BUCKETS; ++b) {
+                    Count += Total.second.Buckets[b];
+
+                    if (b < APOSTOL_METRICS_BUCKETS) {
+                        ::snprintf(szLine, sizeof(szLine), "apostol_request_duration_seconds_bucket{module=\"%s\",le=\"%g\"} %llu\n",
+                                   Total.first.c_str(), (double) (1ull << b) / 1000000, (unsigned long long) Count);
+                    } else {
+                        ::snprintf(szLine, sizeof(szLine), "apostol_request_duration_seconds_bucket{module=\"%s\",le=\"+Inf\"} %llu\n",
+                                   Total.first.c_str(), (unsigned long long) Count);
+                    }
+
+                    Text << szLine;
+                }
+
+                ::snprintf(szLine, sizeof(szLine), "apostol_request_duration_seconds_sum{module=\"%s\"} %.6f\n",
+                           Total.first.c_str(), (double) Total.second.Sum / 1000000);
+                Text << szLine;
+
+                ::snprintf(szLine, sizeof(szLine), "apostol_request_duration_seconds_count{module=\"%s\"} %llu\n",
+                           Total.first.c_str(), (unsigned long long) Count);
+                Text << szLine;
+            }
+        }
+#endif
         //--------------------------------------------------------------------------------------------------------------
 
         //-- CApostolModule --------------------------------------------------------------------------------------------
@@ -56,6 +1063,9 @@ namespace Apostol {
             m_ModuleStatus = msUnknown;
 #ifndef APOSTOL_SERVER_TYPE_TCP
             m_AllowedOriginsLoaded = false;
+            m_MethodTableReady = false;
+            m_DefaultSite = -1;
+            std::fill(m_MethodTable, m_MethodTable + APOSTOL_METHOD_COUNT, nullptr);
             m_Headers.Add("Content-Type");
             m_Headers.Add("X-Requested-With");
 #endif
@@ -153,17 +1163,49 @@ namespace Apostol {
         }
         //--------------------------------------------------------------------------------------------------------------
 
-        const CString &CApostolModule::GetAllowedHeaders() const {
-            if (m_AllowedHeaders.IsEmpty()) {
-                for (int i = 0; i < m_Headers.Count(); ++i) {
-                    if (m_AllowedHeaders.IsEmpty())
-                        m_AllowedHeaders = m_Headers.Strings(i);
-                    else
-                        m_AllowedHeaders += _T(", ") + m_Headers.Strings(i);
-                }
+        const CString &CApostolModule::GetAllowedHeaders() const {
+            if (m_AllowedHeaders.IsEmpty()) {
+                for (int i = 0; i < m_Headers.Count(); ++i) {
+                    if (m_AllowedHeaders.IsEmpty())
+                        m_AllowedHeaders = m_Headers.Strings(i);
+                    else
+                        m_AllowedHeaders += _T(", ") + m_Headers.Strings(i);
+                }
+            }
+
+            return m_AllowedHeaders;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CApostolModule::InitMethodTable() {
+            std::fill(m_MethodTable, m_MethodTable + APOSTOL_METHOD_COUNT, nullptr);
+
+            for (int i = 0; i < m_Methods.Count(); ++i) {
+                const auto pHandler = (CMethodHandler *) m_Methods.Objects(i);
+                if (pHandler->Allow()) {
+                    const auto Method = StrToMethodType(m_Methods.Strings(i).c_str());
+                    if (Method != mtUnknown && m_MethodTable[Method] == nullptr)
+                        m_MethodTable[Method] = pHandler;
+                }
+            }
+
+            m_AllowedMethods.Clear();
+            m_AllowedHeaders.Clear();
+
+            GetAllowedMethods();
+            GetAllowedHeaders();
+
+            m_MethodTableReady = true;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CMethodHandler *CApostolModule::FindMethodHandler(const CString &Method) const {
+            for (int i = 0; i < m_Methods.Count(); ++i) {
+                const auto pHandler = (CMethodHandler *) m_Methods.Objects(i);
+                if (pHandler->Allow() && m_Methods.Strings(i) == Method)
+                    return pHandler;
             }
-
-            return m_AllowedHeaders;
+            return nullptr;
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -179,6 +1221,11 @@ namespace Apostol {
         }
         //--------------------------------------------------------------------------------------------------------------
 
+        void CApostolModule::AddRoute(const CString &Path, const CString &Host) {
+            m_Routes.AddPair(Host, Path);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
         void CApostolModule::InitSites(const CSites &Sites) {
 
             auto InitConfig = [](const CJSON &Config, CStringList &Data) {
@@ -221,37 +1268,110 @@ namespace Apostol {
 
             m_Sites.AddPair("*", Config()->DocRoot());
             InitConfig(Sites.Default().Value(), m_Sites.Last().Data());
+
+            m_SiteEntries.clear();
+            m_SiteHash.clear();
+
+            for (int i = 0; i < m_Sites.Count(); ++i) {
+                const auto &Site = m_Sites[i];
+                const auto &Data = Site.Data();
+
+                CSiteEntry Entry;
+
+                Entry.Index = i;
+                Entry.Root = Site.Value();
+
+                if (!Entry.Root.IsEmpty() && !path_separator(Entry.Root.front())) {
+                    Entry.Root = Config()->Prefix() + Entry.Root;
+                }
+
+                if (!Entry.Root.IsEmpty() && path_separator(Entry.Root.back())) {
+                    Entry.Root.SetLength(Entry.Root.Length() - 1);
+                }
+
+                Entry.OAuth2.Identifier = Data.Values("oauth2.identifier");
+                Entry.OAuth2.Secret = Data.Values("oauth2.secret");
+                Entry.OAuth2.Callback = Data.Values("oauth2.callback");
+                Entry.OAuth2.Error = Data.Values("oauth2.error");
+                Entry.OAuth2.Debug = Data.Values("oauth2.debug");
+
+                m_SiteEntries.push_back(Entry);
+
+                const auto &Host = Site.Name();
+                // The first site wins for a duplicated host, as IndexOfName() did
+                if (IndexOfSite(Host.c_str(), Host.Length()) == -1) {
+                    m_SiteHash.emplace(HashHost(Host.c_str(), Host.Length()), i);
+                }
+            }
+
+            m_DefaultSite = IndexOfSite("*", 1);
         }
         //--------------------------------------------------------------------------------------------------------------
 
-        CString CApostolModule::GetRoot(const CString &Host) const {
-            CString Result(GetSiteRoot(Host));
-
-            if (!path_separator(Result.front())) {
-                Result = Config()->Prefix() + Result;
+        size_t CApostolModule::HashHost(LPCTSTR lpszHost, size_t Length) {
+            // FNV-1a
+            size_t Hash = 14695981039346656037ULL;
+            for (size_t i = 0; i < Length; ++i) {
+                Hash ^= (unsigned char) lpszHost[i];
+                Hash *= 1099511628211ULL;
             }
+            return Hash;
+        }
+        //--------------------------------------------------------------------------------------------------------------
 
-            if (path_separator(Result.back())) {
-                Result.SetLength(Result.Length() - 1);
+        int CApostolModule::IndexOfSite(LPCTSTR lpszHost, size_t Length) const {
+            const auto Range = m_SiteHash.equal_range(HashHost(lpszHost, Length));
+            for (auto it = Range.first; it != Range.second; ++it) {
+                const auto &Host = m_Sites[it->second].Name();
+                if (Host.Length() == Length && strncmp(Host.c_str(), lpszHost, Length) == 0)
+                    return it->second;
             }
+            return -1;
+        }
+        //--------------------------------------------------------------------------------------------------------------
 
-            return Result;
+        const CSiteEntry &CApostolModule::FindSite(LPCTSTR lpszHost, size_t Length) const {
+            static const CSiteEntry Empty;
+
+            auto Index = IndexOfSite(lpszHost, Length);
+            if (Index == -1)
+                Index = m_DefaultSite;
+
+            return Index == -1 ? Empty : m_SiteEntries[Index];
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        const CSiteEntry &CApostolModule::GetSite(const CString &Host) const {
+            return FindSite(Host.c_str(), Host.Length());
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        const CString &CApostolModule::GetRoot(const CString &Host) const {
+            return GetSite(Host).Root;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        const CString &CApostolModule::GetRoot(CHTTPServerConnection *AConnection) const {
+            const auto &caHost = AConnection->Request().Headers[_T("Host")];
+            if (caHost.IsEmpty())
+                return FindSite(_T("localhost"), 9).Root;
+            return FindSite(caHost.c_str(), caHost.Length()).Root;
         }
         //--------------------------------------------------------------------------------------------------------------
 
         const CString &CApostolModule::GetSiteRoot(const CString &Host) const {
-            const auto Index = m_Sites.IndexOfName(Host);
-            if (Index == -1)
+            const auto &Site = GetSite(Host);
+            if (Site.Index == -1)
                 return m_Sites["*"];
-            return m_Sites[Index].Value();
+            return m_Sites[Site.Index].Value();
         }
         //--------------------------------------------------------------------------------------------------------------
 
         const CStringList &CApostolModule::GetSiteConfig(const CString &Host) const {
-            const auto Index = m_Sites.IndexOfName(Host);
-            if (Index == -1)
+            const auto &Site = GetSite(Host);
+            if (Site.Index == -1)
                 return m_Sites.Pairs("*").Data();
-            return m_Sites[Index].Data();
+            return m_Sites[Site.Index].Data();
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -338,6 +1458,11 @@ namespace Apostol {
         }
         //--------------------------------------------------------------------------------------------------------------
 
+        bool CApostolModule::AllowedLocation(const CString &Patch, const CLocationMatcher &Matcher) {
+            return Matcher.Match(Patch);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
         void CApostolModule::ExceptionToJson(int ErrorCode, const std::exception &e, CString& Json) {
             Json.Format(R"({"error": {"code": %u, "message": "%s"}})", ErrorCode, Delphi::Json::EncodeJsonString(e.what()).c_str());
         }
@@ -370,90 +1495,476 @@ namespace Apostol {
 
                 Json << Request.Content;
 
-            } else {
+            } else {
+
+                auto& jsonObject = Json.Object();
+                for (int i = 0; i < Request.Params.Count(); ++i) {
+                    jsonObject.AddPair(Request.Params.Names(i), CHTTPServer::URLDecode(Request.Params.ValueFromIndex(i)));
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CApostolModule::ListToJson(const CStringList &List, CString &Json, bool DataArray, const CString &ObjectName) {
+
+            const auto bResultObject = !ObjectName.IsEmpty();
+
+            DataArray = bResultObject || DataArray || List.Count() > 1;
+
+            const auto emptyData = DataArray ? _T("[]") : _T("{}");
+
+            if (List.Count() == 0) {
+                Json = bResultObject ? CString().Format("{\"%s\": %s}", ObjectName.c_str(), emptyData) : emptyData;
+                return;
+            }
+
+            if (bResultObject)
+                Json.Format("{\"%s\": ", ObjectName.c_str());
+
+            if (DataArray)
+                Json += _T("[");
+
+            for (int i = 0; i < List.Count(); ++i) {
+                const auto& Line = List[i];
+                if (!Line.IsEmpty()) {
+                    if (i > 0)
+                        Json += _T(",");
+                    Json += Line;
+                }
+            }
+
+            if (DataArray)
+                Json += _T("]");
+
+            if (bResultObject)
+                Json += _T("}");
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CApostolModule::ReplyError(CHTTPServerConnection *AConnection, const CHTTPReply::CStatusType ErrorCode, const CString &Message) {
+            Log()->Error(ErrorCode == CHTTPReply::internal_server_error ? APP_LOG_ERR : APP_LOG_WARN, 0, _T("ReplyError: %s"), Message.c_str());
+
+            if (AConnection == nullptr)
+                return;
+
+            auto &Reply = AConnection->Reply();
+
+            Reply.ContentType = CHTTPReply::json;
+
+            if (ErrorCode == CHTTPReply::unauthorized) {
+                CHTTPReply::AddUnauthorized(Reply, AConnection->Data()["Authorization"] != "Basic", "invalid_client", Message.c_str());
+            }
+
+            Reply.Content.Format(R"({"error": {"code": %u, "message": "%s"}})", ErrorCode, Delphi::Json::EncodeJsonString(Message).c_str());
+
+            //AConnection->CloseConnection(true);
+            AConnection->SendReply(ErrorCode, nullptr, true);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CApostolModule::Redirect(CHTTPServerConnection *AConnection, const CString& Location, bool SendNow) const {
+            auto &Reply = AConnection->Reply();
+
+            Reply.Content.Clear();
+            Reply.AddHeader(_T("Location"), Location);
+
+            AConnection->Data().Values("redirect", CString());
+            AConnection->Data().Values("redirect_error", CString());
+
+            AConnection->SendStockReply(CHTTPReply::moved_temporarily, SendNow, GetRoot(AConnection));
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CFileCache &CApostolModule::FileCache() {
+            static CFileCache FileCache;
+            return FileCache;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CMemoryCache &CApostolModule::MemoryCache() {
+            static CMemoryCache MemoryCache;
+            return MemoryCache;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+#ifdef WITH_ZLIB
+        CGzipCache &CApostolModule::GzipCache() {
+            static CGzipCache GzipCache;
+            return GzipCache;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+#endif
+        bool CApostolModule::Compressible(LPCTSTR AContentType) {
+            if (AContentType == nullptr)
+                return false;
+
+            return strncmp(AContentType, "text/", 5) == 0 || strstr(AContentType, "javascript") != nullptr ||
+                strstr(AContentType, "json") != nullptr || strstr(AContentType, "xml") != nullptr;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CApostolModule::AcceptEncoding(const CString &Value, LPCTSTR ACoding) {
+            const size_t Length = strlen(ACoding);
+
+            LPCTSTR P = Value.c_str();
+
+            while (*P != '\0') {
+                while (*P == ' ' || *P == ',')
+                    P++;
+
+                LPCTSTR Token = P;
+                while (*P != '\0' && *P != ',' && *P != ';' && *P != ' ')
+                    P++;
+
+                const size_t TokenLength = P - Token;
+
+                // "gzip;q=0" explicitly refuses the coding
+                bool Refused = false;
+                while (*P != '\0' && *P != ',') {
+                    if ((*P == 'q' || *P == 'Q') && P[1] == '=') {
+                        Refused = strtod(P + 2, nullptr) == 0;
+                        break;
+                    }
+                    P++;
+                }
+
+                if (!Refused && TokenLength > 0) {
+                    if ((TokenLength == Length && strncasecmp(Token, ACoding, Length) == 0) || (TokenLength == 1 && *Token == '*'))
+                        return true;
+                }
+
+                while (*P != '\0' && *P != ',')
+                    P++;
+            }
+
+            return false;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        LPCTSTR CApostolModule::SelectEncoding(CHTTPServerConnection *AConnection, CString &Resource, const CFileInfo &Info,
+                LPCTSTR AContentType) const {
+
+            if (!Compressible(AContentType))
+                return nullptr;
+
+            auto &Reply = AConnection->Reply();
+
+            Reply.AddHeader(_T("Vary"), _T("Accept-Encoding"));
+
+            const auto &caAccept = AConnection->Request().Headers[_T("Accept-Encoding")];
+            if (caAccept.IsEmpty())
+                return nullptr;
+
+            auto &Cache = FileCache();
+
+            if (AcceptEncoding(caAccept, "br")) {
+                const CString sEncoded(Resource + ".br");
+                if (Cache.FileExists(sEncoded.c_str())) {
+                    Resource = sEncoded;
+                    Reply.AddHeader(_T("Content-Encoding"), _T("br"));
+                    return _T("br");
+                }
+            }
+
+            if (AcceptEncoding(caAccept, "gzip")) {
+                const CString sEncoded(Resource + ".gz");
+                if (Cache.FileExists(sEncoded.c_str())) {
+                    Resource = sEncoded;
+                    Reply.AddHeader(_T("Content-Encoding"), _T("gzip"));
+                    return _T("gzip");
+                }
+#ifdef WITH_ZLIB
+                if (Info.Size < APOSTOL_GZIP_MIN_LENGTH)
+                    return nullptr;
+
+                const auto &sCached = CGzipCache::CacheFile(Resource, Info.Modified);
+                if (Cache.FileExists(sCached.c_str())) {
+                    Resource = sCached;
+                    Reply.AddHeader(_T("Content-Encoding"), _T("gzip"));
+                    return _T("gzip");
+                }
+
+                GzipCache().Enqueue(Resource, sCached);
+#endif
+            }
+
+            return nullptr;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CString CApostolModule::GetETag(const CFileInfo &Info, LPCTSTR AEncoding) {
+            CString Result;
+
+            if (AEncoding == nullptr) {
+                Result.Format("\"%lx-%lx-%lx\"", (unsigned long) Info.Inode, (unsigned long) Info.Modified,
+                    (unsigned long) Info.Size);
+            } else {
+                // An encoded variant is a different representation: weak, and its opaque value names the coding
+                Result.Format("W/\"%lx-%lx-%lx-%s\"", (unsigned long) Info.Inode, (unsigned long) Info.Modified,
+                    (unsigned long) Info.Size, strcmp(AEncoding, "gzip") == 0 ? "gz" : AEncoding);
+            }
+
+            return Result;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CApostolModule::MatchETag(const CString &List, const CString &ETag) {
+            // If-None-Match uses the weak comparison: the "W/" prefix is ignored on both sides
+            LPCTSTR lpszTag = ETag.c_str();
+            if (strncmp(lpszTag, "W/", 2) == 0)
+                lpszTag += 2;
+
+            const size_t Length = strlen(lpszTag);
+
+            LPCTSTR P = List.c_str();
+
+            while (*P != '\0') {
+                while (*P == ' ' || *P == ',')
+                    P++;
+
+                if (*P == '*')
+                    return true;
+
+                if (strncmp(P, "W/", 2) == 0)
+                    P += 2;
+
+                LPCTSTR Token = P;
+                while (*P != '\0' && *P != ',' && *P != ' ')
+                    P++;
+
+                if ((size_t) (P - Token) == Length && strncmp(Token, lpszTag, Length) == 0)
+                    return true;
+            }
+
+            return false;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CApostolModule::NotModified(const CHTTPRequest &Request, const CString &ETag, time_t Modified) {
+            const auto &caNoneMatch = Request.Headers[_T("If-None-Match")];
+
+            // If-Modified-Since is ignored when If-None-Match is present
+            if (!caNoneMatch.IsEmpty())
+                return MatchETag(caNoneMatch, ETag);
+
+            const auto &caModifiedSince = Request.Headers[_T("If-Modified-Since")];
+            if (caModifiedSince.IsEmpty())
+                return false;
+
+            const auto Since = WebTimeToTime(caModifiedSince.c_str());
+
+            return Since != (time_t) -1 && Modified <= Since;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CApostolModule::ParseRange(const CString &Range, off_t Size, CByteRanges &Ranges) {
+            LPCTSTR P = Range.c_str();
+
+            if (strncasecmp(P, "bytes=", 6) != 0)
+                return false;
+
+            P += 6;
+
+            int Count = 0;
+
+            while (*P != '\0') {
+                while (*P == ' ' || *P == ',')
+                    P++;
+
+                if (*P == '\0')
+                    break;
+
+                if (++Count > APOSTOL_RANGE_MAX_COUNT)
+                    return false;
+
+                LPTSTR End = nullptr;
+
+                off_t First;
+                off_t Last;
+
+                if (*P == '-') {
+                    // Suffix range: the last N bytes
+                    const auto Suffix = strtoll(P + 1, &End, 10);
+                    if (End == P + 1 || Suffix < 0)
+                        return false;
+
+                    if (Suffix == 0 || Size == 0) {
+                        P = End;
+                        continue;
+                    }
+
+                    First = Suffix >= Size ? 0 : Size - Suffix;
+                    Last = Size - 1;
+                } else {
+                    First = strtoll(P, &End, 10);
+                    if (End == P || *End != '-' || First < 0)
+                        return false;
+
+                    P = End + 1;
+
+                    if (*P >= '0' && *P <= '9') {
+                        Last = strtoll(P, &End, 10);
+                        if (Last < First)
+                            return false;
+                    } else {
+                        Last = Size - 1;
+                        End = (LPTSTR) P;
+                    }
+
+                    if (First >= Size) {
+                        P = End;
+                        continue;
+                    }
+
+                    if (Last >= Size)
+                        Last = Size - 1;
+                }
+
+                Ranges.emplace_back(First, Last);
+
+                P = End;
+                while (*P == ' ')
+                    P++;
+
+                if (*P != '\0' && *P != ',')
+                    return false;
+            }
+
+            return Count > 0;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CApostolModule::ReadRange(int Handle, off_t Offset, size_t Count, CString &Content) {
+            const auto Pos = Content.Length();
+
+            Content.SetLength(Pos + Count);
+
+            size_t Done = 0;
+            while (Done < Count) {
+                const auto Size = ::pread(Handle, Content.Data() + Pos + Done, Count - Done, Offset + (off_t) Done);
+                if (Size <= 0) {
+                    if (Size == -1 && errno == EINTR)
+                        continue;
+                    return false;
+                }
+                Done += Size;
+            }
+
+            return true;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CApostolModule::SendRange(CHTTPServerConnection *AConnection, const CString &Resource, const CFileInfo &Info,
+                const CString &ETag, LPCTSTR AContentType, bool SendNow) {
+
+            const auto &caRequest = AConnection->Request();
+
+            const auto &caRange = caRequest.Headers[_T("Range")];
+            if (caRange.IsEmpty())
+                return false;
 
-                auto& jsonObject = Json.Object();
-                for (int i = 0; i < Request.Params.Count(); ++i) {
-                    jsonObject.AddPair(Request.Params.Names(i), CHTTPServer::URLDecode(Request.Params.ValueFromIndex(i)));
+            // A stale If-Range turns the request into a plain GET of the whole file
+            const auto &caIfRange = caRequest.Headers[_T("If-Range")];
+            if (!caIfRange.IsEmpty()) {
+                if (caIfRange.front() == '"') {
+                    if (caIfRange != ETag)
+                        return false;
+                } else if (caIfRange.front() == 'W') {
+                    return false;
+                } else if (WebTimeToTime(caIfRange.c_str()) != Info.Modified) {
+                    return false;
                 }
             }
-        }
-        //--------------------------------------------------------------------------------------------------------------
-
-        void CApostolModule::ListToJson(const CStringList &List, CString &Json, bool DataArray, const CString &ObjectName) {
 
-            const auto bResultObject = !ObjectName.IsEmpty();
+            CByteRanges Ranges;
+            if (!ParseRange(caRange, Info.Size, Ranges))
+                return false;
 
-            DataArray = bResultObject || DataArray || List.Count() > 1;
+            auto &Reply = AConnection->Reply();
 
-            const auto emptyData = DataArray ? _T("[]") : _T("{}");
+            TCHAR szBuffer[MAX_BUFFER_SIZE + 1] = {0};
 
-            if (List.Count() == 0) {
-                Json = bResultObject ? CString().Format("{\"%s\": %s}", ObjectName.c_str(), emptyData) : emptyData;
-                return;
+            if (Ranges.empty()) {
+                Reply.Content.Clear();
+                snprintf(szBuffer, sizeof(szBuffer), "bytes */%lld", (long long) Info.Size);
+                Reply.AddHeader(_T("Content-Range"), szBuffer);
+                AConnection->SendReply(CHTTPReply::range_not_satisfiable, nullptr, SendNow);
+                return true;
             }
 
-            if (bResultObject)
-                Json.Format("{\"%s\": ", ObjectName.c_str());
+            off_t Total = 0;
+            for (const auto &Range : Ranges) {
+                Total += Range.second - Range.first + 1;
+            }
 
-            if (DataArray)
-                Json += _T("[");
+            // Ranges are read into memory: above APOSTOL_RANGE_MAX_WINDOW bytes the Range header is ignored
+            // (RFC 9110, 14.2) and the whole file goes out as 200 through sendfile()
+            if (Total > APOSTOL_RANGE_MAX_WINDOW)
+                return false;
 
-            for (int i = 0; i < List.Count(); ++i) {
-                const auto& Line = List[i];
-                if (!Line.IsEmpty()) {
-                    if (i > 0)
-                        Json += _T(",");
-                    Json += Line;
-                }
+            const auto Handle = ::open(Resource.c_str(), O_RDONLY | O_CLOEXEC);
+            if (Handle == -1) {
+                GLog->Error(APP_LOG_ERR, errno, _T("open \"%s\" failed"), Resource.c_str());
+                AConnection->SendStockReply(CHTTPReply::internal_server_error, SendNow);
+                return true;
             }
 
-            if (DataArray)
-                Json += _T("]");
+            auto &Content = Reply.Content;
+            Content.Clear();
 
-            if (bResultObject)
-                Json += _T("}");
-        }
-        //--------------------------------------------------------------------------------------------------------------
+            bool Success = true;
 
-        void CApostolModule::ReplyError(CHTTPServerConnection *AConnection, const CHTTPReply::CStatusType ErrorCode, const CString &Message) {
-            Log()->Error(ErrorCode == CHTTPReply::internal_server_error ? APP_LOG_ERR : APP_LOG_WARN, 0, _T("ReplyError: %s"), Message.c_str());
+            if (Ranges.size() == 1) {
+                const auto &Range = Ranges.front();
 
-            if (AConnection == nullptr)
-                return;
+                snprintf(szBuffer, sizeof(szBuffer), "bytes %lld-%lld/%lld", (long long) Range.first,
+                    (long long) Range.second, (long long) Info.Size);
+                Reply.AddHeader(_T("Content-Range"), szBuffer);
 
-            auto &Reply = AConnection->Reply();
+                Success = ReadRange(Handle, Range.first, Range.second - Range.first + 1, Content);
+            } else {
+                TCHAR szBoundary[40] = {0};
+                snprintf(szBoundary, sizeof(szBoundary), "%016lx%08lx", (unsigned long) Info.Inode, (unsigned long) random());
 
-            Reply.ContentType = CHTTPReply::json;
+                for (const auto &Range : Ranges) {
+                    snprintf(szBuffer, sizeof(szBuffer), "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n",
+                        szBoundary, AContentType == nullptr ? "application/octet-stream" : AContentType,
+                        (long long) Range.first, (long long) Range.second, (long long) Info.Size);
+                    Content << szBuffer;
 
-            if (ErrorCode == CHTTPReply::unauthorized) {
-                CHTTPReply::AddUnauthorized(Reply, AConnection->Data()["Authorization"] != "Basic", "invalid_client", Message.c_str());
-            }
+                    if (!ReadRange(Handle, Range.first, Range.second - Range.first + 1, Content)) {
+                        Success = false;
+                        break;
+                    }
+                }
 
-            Reply.Content.Format(R"({"error": {"code": %u, "message": "%s"}})", ErrorCode, Delphi::Json::EncodeJsonString(Message).c_str());
+                snprintf(szBuffer, sizeof(szBuffer), "\r\n--%s--\r\n", szBoundary);
+                Content << szBuffer;
 
-            //AConnection->CloseConnection(true);
-            AConnection->SendReply(ErrorCode, nullptr, true);
-        }
-        //--------------------------------------------------------------------------------------------------------------
+                snprintf(szBuffer, sizeof(szBuffer), "multipart/byteranges; boundary=%s", szBoundary);
+            }
 
-        void CApostolModule::Redirect(CHTTPServerConnection *AConnection, const CString& Location, bool SendNow) const {
-            auto &Reply = AConnection->Reply();
+            const auto Error = errno;
 
-            Reply.Content.Clear();
-            Reply.AddHeader(_T("Location"), Location);
+            ::close(Handle);
 
-            AConnection->Data().Values("redirect", CString());
-            AConnection->Data().Values("redirect_error", CString());
+            if (!Success) {
+                GLog->Error(APP_LOG_ERR, Error, _T("pread \"%s\" failed"), Resource.c_str());
+                Content.Clear();
+                AConnection->SendStockReply(CHTTPReply::internal_server_error, SendNow);
+                return true;
+            }
+
+            AConnection->SendReply(CHTTPReply::partial_content, Ranges.size() == 1 ? AContentType : szBuffer, SendNow);
 
-            AConnection->SendStockReply(CHTTPReply::moved_temporarily, SendNow, GetRoot(GetHost(AConnection)));
+            return true;
         }
         //--------------------------------------------------------------------------------------------------------------
 
         CString CApostolModule::TryFiles(const CString &Root, const CStringList &uris, const CString &Location) {
+            auto &Cache = FileCache();
             for (int i = 0; i < uris.Count(); i++) {
                 const auto& uri = Root + uris[i];
-                if (FileExists(uri.c_str())) {
+                if (Cache.FileExists(uri.c_str())) {
                     return uri;
                 }
             }
@@ -462,10 +1973,12 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         bool CApostolModule::ResourceExists(CString &Resource, const CString &Root, const CString &Path, const CStringList &TryFiles) {
+            auto &Cache = FileCache();
+
             Resource = Root;
             Resource += Path;
 
-            if (DirectoryExists(Resource.c_str())) {
+            if (Cache.DirectoryExists(Resource.c_str())) {
                 if (!path_separator(Resource.back())) {
                     Resource += '/';
                 }
@@ -474,11 +1987,11 @@ namespace Apostol {
                 Resource.SetLength(Resource.Length() - 1);
             }
 
-            if (TryFiles.Count() != 0 && !FileExists(Resource.c_str())) {
+            if (TryFiles.Count() != 0 && !Cache.FileExists(Resource.c_str())) {
                 Resource = CApostolModule::TryFiles(Root, TryFiles, Path);
             }
 
-            return FileExists(Resource.c_str());
+            return Cache.FileExists(Resource.c_str());
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -487,7 +2000,7 @@ namespace Apostol {
 
             auto &Reply = AConnection->Reply();
 
-            const CString sRoot(GetRoot(GetHost(AConnection)));
+            const auto &sRoot = GetRoot(AConnection);
             CString sResource;
 
             if (!ResourceExists(sResource, sRoot, Path, TryFiles)) {
@@ -499,17 +2012,61 @@ namespace Apostol {
 
             TCHAR szBuffer[MAX_BUFFER_SIZE + 1] = {0};
 
+            const auto caInfo = FileCache().Stat(sResource);
+
             if (AContentType == nullptr) {
-                CString sFileExt;
-                sFileExt = ExtractFileExt(szBuffer, sResource.c_str());
-                AContentType = Mapping::ExtToType(sFileExt.c_str());
+                AContentType = caInfo.ContentType;
             }
 
-            const auto sModified = StrWebTime(FileAge(sResource.c_str()), szBuffer, sizeof(szBuffer));
+            const auto sModified = StrWebTime(caInfo.Modified, szBuffer, sizeof(szBuffer));
             if (sModified != nullptr) {
                 Reply.AddHeader(_T("Last-Modified"), sModified);
             }
 
+            const auto lpszEncoding = SelectEncoding(AConnection, sResource, caInfo, AContentType);
+
+            // Encoded variants get their own weak tag, so a cached identity body never validates a gzip one
+            const auto &sETag = GetETag(caInfo, lpszEncoding);
+            Reply.AddHeader(_T("ETag"), sETag);
+
+            if (NotModified(AConnection->Request(), sETag, caInfo.Modified)) {
+                AConnection->SendReply(CHTTPReply::not_modified, nullptr, SendNow);
+                return true;
+            }
+
+            if (lpszEncoding == nullptr) {
+                if (SendRange(AConnection, sResource, caInfo, sETag, AContentType, SendNow))
+                    return true;
+
+                Reply.AddHeader(_T("Accept-Ranges"), _T("bytes"));
+            }
+
+            // Small files are answered from memory: no open(), no read()/sendfile() from disk
+            if (Config()->MemoryCacheSize() > 0) {
+                const auto caFile = lpszEncoding == nullptr ? caInfo : FileCache().Stat(sResource);
+
+                if (caFile.Exists && (size_t) caFile.Size <= Config()->MemoryCacheFile()) {
+                    auto &Cache = MemoryCache();
+
+                    auto pContent = Cache.Find(sResource, caFile);
+                    if (pContent == nullptr) {
+                        const auto Handle = ::open(sResource.c_str(), O_RDONLY | O_CLOEXEC);
+                        if (Handle != -1) {
+                            CString Content;
+                            if (ReadRange(Handle, 0, caFile.Size, Content))
+                                pContent = Cache.Add(sResource, caFile, Content);
+                            ::close(Handle);
+                        }
+                    }
+
+                    if (pContent != nullptr) {
+                        Reply.Content = *pContent;
+                        AConnection->SendReply(CHTTPReply::ok, AContentType, SendNow);
+                        return true;
+                    }
+                }
+            }
+
 #if (APOSTOL_USE_SEND_FILE)
   #if (OPENSSL_VERSION_NUMBER >= 0x30000000L) && defined(BIO_get_ktls_send)
             AConnection->SendFileReply(sResource.c_str(), AContentType);
@@ -537,7 +2094,7 @@ namespace Apostol {
 
             // Request sPath must be absolute and not contain "..".
             if (sPath.empty() || sPath.front() != '/' || sPath.find("..") != CString::npos) {
-                AConnection->SendStockReply(CHTTPReply::bad_request, false, GetRoot(GetHost(AConnection)));
+                AConnection->SendStockReply(CHTTPReply::bad_request, false, GetRoot(AConnection));
                 return;
             }
 
@@ -549,25 +2106,33 @@ namespace Apostol {
             CString sResource(GetRoot(caRequest.Location.Host()));
             sResource += sPath;
 
-            if (!FileExists(sResource.c_str())) {
-                AConnection->SendStockReply(CHTTPReply::not_found, false, GetRoot(GetHost(AConnection)));
+            const auto &caInfo = FileCache().Stat(sResource);
+
+            if (!caInfo.Exists || caInfo.Directory) {
+                AConnection->SendStockReply(CHTTPReply::not_found, false, GetRoot(AConnection));
                 return;
             }
 
             TCHAR szBuffer[MAX_BUFFER_SIZE + 1] = {0};
 
-            auto contentType = Mapping::ExtToType(ExtractFileExt(szBuffer, sResource.c_str()));
-            if (contentType != nullptr) {
-                Reply.AddHeader(_T("Content-Type"), contentType);
+            if (caInfo.ContentType != nullptr) {
+                Reply.AddHeader(_T("Content-Type"), caInfo.ContentType);
             }
 
-            auto fileSize = FileSize(sResource.c_str());
-            Reply.AddHeader(_T("Content-Length"), IntToStr((int) fileSize, szBuffer, sizeof(szBuffer)));
+            Reply.AddHeader(_T("Content-Length"), IntToStr((int) caInfo.Size, szBuffer, sizeof(szBuffer)));
 
-            auto LModified = StrWebTime(FileAge(sResource.c_str()), szBuffer, sizeof(szBuffer));
+            auto LModified = StrWebTime(caInfo.Modified, szBuffer, sizeof(szBuffer));
             if (LModified != nullptr)
                 Reply.AddHeader(_T("Last-Modified"), LModified);
 
+            const auto &sETag = GetETag(caInfo);
+            Reply.AddHeader(_T("ETag"), sETag);
+
+            if (NotModified(caRequest, sETag, caInfo.Modified)) {
+                AConnection->SendReply(CHTTPReply::not_modified);
+                return;
+            }
+
             AConnection->SendReply(CHTTPReply::no_content);
         }
         //--------------------------------------------------------------------------------------------------------------
@@ -599,7 +2164,7 @@ namespace Apostol {
 
             // Request sPath must be absolute and not contain "..".
             if (sPath.empty() || sPath.front() != '/' || sPath.find(_T("..")) != CString::npos) {
-                AConnection->SendStockReply(CHTTPReply::bad_request, false, GetRoot(GetHost(AConnection)));
+                AConnection->SendStockReply(CHTTPReply::bad_request, false, GetRoot(AConnection));
                 return;
             }
 
@@ -676,22 +2241,18 @@ namespace Apostol {
             Reply.Clear();
             Reply.ContentType = CHTTPReply::html;
 
-            int i;
-            for (i = 0; i < m_Methods.Count(); ++i) {
-                const auto pHandler = (CMethodHandler *) m_Methods.Objects(i);
+            if (!m_MethodTableReady)
+                InitMethodTable();
 
-                if (pHandler->Allow()) {
-                    const CString& Method = m_Methods.Strings(i);
-                    if (Method == caRequest.Method) {
-                        CORS(AConnection);
-                        pHandler->Handler(AConnection);
-                        break;
-                    }
-                }
-            }
+            // Extension methods are not in the table and are looked up by name
+            const auto Method = StrToMethodType(caRequest.Method.c_str());
+            const auto pHandler = Method == mtUnknown ? FindMethodHandler(caRequest.Method) : m_MethodTable[Method];
 
-            if (i == m_Methods.Count()) {
-                AConnection->SendStockReply(CHTTPReply::not_implemented, false, GetRoot(GetHost(AConnection)));
+            if (pHandler == nullptr) {
+                AConnection->SendStockReply(CHTTPReply::not_implemented, false, GetRoot(AConnection));
+            } else {
+                CORS(AConnection);
+                pHandler->Handler(AConnection);
             }
 
             return true;
@@ -725,24 +2286,44 @@ namespace Apostol {
             if (bResultObject)
                 Json.Format("{\"%s\": ", ObjectName.c_str());
 
+            const auto nullData = bDataArray ? _T("null") : _T("{}");
+            const auto nullSize = strlen(nullData);
+
+            const int tuples = Result->nTuples();
+
+            // Size the reply up front: Json grows once and every value is copied out of the PGresult exactly once
+            size_t size = (bDataArray ? 2 : 0) + (size_t) (tuples - 1) + (bResultObject ? 1 : 0);
+            for (int row = 0; row < tuples; ++row) {
+                size += Result->GetIsNull(row, 0) ? nullSize : (size_t) Result->GetLength(row, 0);
+            }
+
+            const auto Pos = Json.Length();
+            Json.SetLength(Pos + size);
+
+            auto p = Json.Data() + Pos;
+
             if (bDataArray)
-                Json += _T("[");
+                *p++ = '[';
 
-            for (int row = 0; row < Result->nTuples(); ++row) {
-                if (!Result->GetIsNull(row, 0)) {
-                    if (row > 0)
-                        Json += _T(",");
-                    Json.Append(Result->GetValue(row, 0), Result->GetLength(row, 0));
+            for (int row = 0; row < tuples; ++row) {
+                if (row > 0)
+                    *p++ = ',';
+
+                if (Result->GetIsNull(row, 0)) {
+                    ::memcpy(p, nullData, nullSize);
+                    p += nullSize;
                 } else {
-                    Json += bDataArray ? _T("null") : _T("{}");
+                    const auto length = (size_t) Result->GetLength(row, 0);
+                    ::memcpy(p, Result->GetValue(row, 0), length);
+                    p += length;
                 }
             }
 
             if (bDataArray)
-                Json += _T("]");
+                *p++ = ']';
 
             if (bResultObject)
-                Json += _T("}");
+                *p = '}';
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -827,6 +2408,40 @@ namespace Apostol {
         }
         //--------------------------------------------------------------------------------------------------------------
 
+        CPQPollQuery *CApostolModule::ExecSQL(const CString &Statement, const CSQLParams &Params,
+                CPollConnection *AConnection, COnPQPollQueryExecutedEvent &&OnExecuted,
+                COnPQPollQueryExceptionEvent &&OnException, const CString &ConfName) {
+
+            CString Text;
+            CSQLBinder::Bind(Statement, Params, Text, m_pModuleProcess->ClientEncoding(ConfName));
+
+            CStringList SQL;
+            SQL.Add(Text);
+
+            return ExecSQL(SQL, AConnection, static_cast<COnPQPollQueryExecutedEvent &&>(OnExecuted),
+                static_cast<COnPQPollQueryExceptionEvent &&>(OnException), ConfName);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CPQPollQuery *CApostolModule::ExecSQL(const CSQLBatch &Batch, CPollConnection *AConnection,
+                COnPQPollQueryExecutedEvent &&OnExecuted, COnPQPollQueryExceptionEvent &&OnException,
+                const CString &ConfName) {
+
+            if (Batch.Count() == 0)
+                throw Delphi::Exception::Exception(_T("ExecSQL: SQL batch is empty."));
+
+            if (Batch.Bound() && !CSQLBinder::SafeEncoding(m_pModuleProcess->ClientEncoding(ConfName)))
+                throw Delphi::Exception::ExceptionFrm(_T("ExecSQL: Bound parameters cannot be escaped for client_encoding \"%s\"."),
+                                                      m_pModuleProcess->ClientEncoding(ConfName).c_str());
+
+            CStringList SQL;
+            Batch.Pack(SQL);
+
+            return ExecSQL(SQL, AConnection, static_cast<COnPQPollQueryExecutedEvent &&>(OnExecuted),
+                static_cast<COnPQPollQueryExceptionEvent &&>(OnException), ConfName);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
         CPQPollQuery *CApostolModule::ExecuteSQL(const CStringList &SQL, CHTTPServerConnection *AConnection,
                 COnApostolModuleSuccessEvent &&OnSuccess, COnApostolModuleFailEvent &&OnFail,
                 const CString &ConfName) {
@@ -857,6 +2472,112 @@ namespace Apostol {
         }
         //--------------------------------------------------------------------------------------------------------------
 
+        void CApostolModule::QueueSQL(const CString &SQL, CHTTPServerConnection *AConnection,
+                COnApostolModuleResultEvent &&OnResult, COnApostolModuleFailEvent &&OnFail,
+                const CString &ConfName, bool ReadOnly) {
+
+            auto OnExecuted = [OnResult](CPollConnection *ABinding, CPQResult *AResult) {
+                const auto pConnection = dynamic_cast<CHTTPServerConnection *> (ABinding);
+                if (pConnection != nullptr && pConnection->Connected()) {
+                    OnResult(pConnection, AResult);
+                }
+            };
+
+            auto OnException = [OnFail](CPollConnection *ABinding, const Delphi::Exception::Exception &E) {
+                const auto pConnection = dynamic_cast<CHTTPServerConnection *> (ABinding);
+                if (OnFail != nullptr && pConnection != nullptr && pConnection->Connected()) {
+                    OnFail(pConnection, E);
+                }
+            };
+
+            try {
+                m_pModuleProcess->QueueSQL(SQL, AConnection, OnExecuted, OnException, ConfName, ReadOnly);
+            } catch (Delphi::Exception::Exception &E) {
+                if (OnFail != nullptr)
+                    OnFail(AConnection, E);
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CApostolModule::ExecuteCachedSQL(const CString &SQL, CHTTPServerConnection *AConnection, u_int TTL,
+                const CStringList &Channels, const CString &ConfName) {
+#ifndef APOSTOL_SERVER_TYPE_TCP
+            auto &Cache = CServerProcess::QueryCache();
+
+            const auto pContent = Cache.Find(ConfName, SQL);
+            if (pContent != nullptr) {
+                AConnection->Reply().Content = *pContent;
+                AConnection->SendReply(CHTTPReply::ok, nullptr, true);
+                return;
+            }
+
+            for (int i = 0; i < Channels.Count(); i++) {
+                m_pModuleProcess->ListenChannel(Channels[i], ConfName);
+            }
+
+            // Checked before the query goes out: a reply read before its LISTENs were in place, or invalidated
+            // while the query was running, is not stored
+            const auto cacheable = Cache.Confirmed(ConfName, Channels);
+            const auto version = Cache.Version();
+
+            const auto ttl = TTL == 0 ? Config()->QueryCacheTTL() : TTL;
+
+            auto OnExecuted = [SQL, ttl, Channels, ConfName, cacheable, version](CPQPollQuery *APollQuery) {
+                const auto pConnection = dynamic_cast<CHTTPServerConnection *> (APollQuery->Binding());
+                const auto pResult = APollQuery->Results(0);
+
+                const auto bConnected = pConnection != nullptr && pConnection->Connected();
+
+                CHTTPReply::CStatusType status = CHTTPReply::internal_server_error;
+
+                // Serialize straight into the reply, the cache takes its own copy
+                CString Buffer;
+                auto &Content = bConnected ? pConnection->Reply().Content : Buffer;
+
+                try {
+                    if (pResult->ExecStatus() != PGRES_TUPLES_OK)
+                        throw Delphi::Exception::EDBError(pResult->GetErrorMessage());
+
+                    status = CHTTPReply::ok;
+                    Postgres::PQResultToJson(pResult, Content);
+
+                    if (cacheable)
+                        CServerProcess::QueryCache().Add(ConfName, SQL, Content, ttl, Channels, version);
+                } catch (Delphi::Exception::Exception &E) {
+                    ExceptionToJson(status, E, Content);
+                    Log()->Error(APP_LOG_ERR, 0, "%s", E.what());
+                }
+
+                if (bConnected) {
+                    pConnection->SendReply(status, nullptr, true);
+                }
+            };
+
+            CStringList Query;
+            Query.Add(SQL);
+
+            try {
+                ExecSQL(Query, AConnection, OnExecuted, nullptr, ConfName);
+            } catch (Delphi::Exception::Exception &E) {
+                CHTTPReply::CStatusType status = CHTTPReply::internal_server_error;
+                ExceptionToJson(status, E, AConnection->Reply().Content);
+                AConnection->SendReply(status, nullptr, true);
+                Log()->Error(APP_LOG_ERR, 0, "%s", E.what());
+            }
+#endif
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CApostolModule::ExecuteCachedSQL(const CString &Statement, const CSQLParams &Params,
+                CHTTPServerConnection *AConnection, u_int TTL, const CStringList &Channels, const CString &ConfName) {
+
+            CString SQL;
+            CSQLBinder::Bind(Statement, Params, SQL, m_pModuleProcess->ClientEncoding(ConfName));
+
+            ExecuteCachedSQL(SQL, AConnection, TTL, Channels, ConfName);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
         void CApostolModule::DoPostgresNotify(CPQConnection *AConnection, PGnotify *ANotify) {
 
         }
@@ -894,7 +2615,7 @@ namespace Apostol {
 
             CHTTPReply::CStatusType status = CHTTPReply::internal_server_error;
             ExceptionToJson(status, E, Reply.Content);
-            pConnection->SendStockReply(status, true, GetRoot(GetHost(pConnection)));
+            pConnection->SendStockReply(status, true, GetRoot(pConnection));
 #endif
             Log()->Error(APP_LOG_ERR, 0, "%s", E.what());
         }
@@ -961,8 +2682,18 @@ namespace Apostol {
             const auto pTimer = dynamic_cast<CEPollTimer *> (AHandler->Binding());
             pTimer->Read(&exp, sizeof(uint64_t));
 
+            CCachedTime::Update();
+
+            Log()->FlushSuppressed();
+
             try {
                 HeartbeatModules(AHandler->TimeStamp());
+#ifndef APOSTOL_SERVER_TYPE_TCP
+                CApostolModule::FileCache().Update();
+#endif
+#if !defined(APOSTOL_SERVER_TYPE_TCP) && defined(WITH_ZLIB)
+                CApostolModule::GzipCache().Process(APOSTOL_GZIP_TICK_BUDGET);
+#endif
             } catch (Delphi::Exception::Exception &E) {
                 DoServerEventHandlerException(AHandler, E);
             }
@@ -970,6 +2701,8 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 #ifdef WITH_STREAM_SERVER
         void CModuleProcess::DoExecuteStream(CUDPAsyncServer *AServer, CSocketHandle *ASocket, CManagedBuffer &ABuffer) {
+            CCachedTime::Update();
+
             try {
                 ExecuteStreamModules(AServer, ASocket, ABuffer);
             } catch (Delphi::Exception::Exception &E) {
@@ -977,8 +2710,46 @@ namespace Apostol {
             }
         }
         //--------------------------------------------------------------------------------------------------------------
+#endif
+#ifndef APOSTOL_SERVER_TYPE_TCP
+        /// Host (the port is ignored) is one of the space or comma separated List, "*" matches any
+        static bool MatchHost(const CString &List, const CString &Host) {
+            auto Length = Host.Length();
+
+            // "name:port" or "[::1]:port"
+            const auto Colon = strrchr(Host.c_str(), ':');
+            if (Colon != nullptr && strchr(Colon, ']') == nullptr && (Host.front() == '[' || strchr(Host.c_str(), ':') == Colon))
+                Length = (size_t) (Colon - Host.c_str());
+
+            LPCTSTR P = List.c_str();
+
+            while (*P != '\0') {
+                while (*P == ' ' || *P == ',')
+                    P++;
+
+                LPCTSTR End = P;
+                while (*End != '\0' && *End != ' ' && *End != ',')
+                    End++;
+
+                const auto Size = (size_t) (End - P);
+
+                if (Size == 1 && *P == '*')
+                    return true;
+
+                if (Size != 0 && Size == Length && strncasecmp(P, Host.c_str(), Size) == 0)
+                    return true;
+
+                P = End;
+            }
+
+            return false;
+        }
+        //--------------------------------------------------------------------------------------------------------------
 #endif
         bool CModuleProcess::DoExecute(CTCPConnection *AConnection) {
+            // Server().Wait() dispatches a whole epoll batch: a slow handler must not age the time of the next
+            CCachedTime::Update();
+
 #ifdef APOSTOL_SERVER_TYPE_TCP
             const auto pConnection = dynamic_cast<CTCPServerConnection *> (AConnection);
 #else
@@ -988,6 +2759,31 @@ namespace Apostol {
                 return false;
             }
 
+#ifndef APOSTOL_SERVER_TYPE_TCP
+            if (Config()->Metrics() && Metrics().Active() && pConnection->Request().Location.pathname == APOSTOL_METRICS_LOCATION &&
+                    MatchHost(Config()->MetricsHost(), pConnection->Request().Headers[_T("Host")])) {
+                auto &Reply = pConnection->Reply();
+
+                Reply.Content.Clear();
+                Metrics().Render(Reply.Content);
+
+                pConnection->SendReply(CHTTPReply::ok, _T("text/plain; version=0.0.4"));
+
+                return true;
+            }
+
+            if (Config()->Status() && Scoreboard().Active() && pConnection->Request().Location.pathname == APOSTOL_STATUS_LOCATION &&
+                    MatchHost(Config()->StatusHost(), pConnection->Request().Headers[_T("Host")])) {
+                auto &Reply = pConnection->Reply();
+
+                Reply.Content.Clear();
+                Scoreboard().Render(Reply.Content);
+
+                pConnection->SendReply(CHTTPReply::ok, _T("text/plain"));
+
+                return true;
+            }
+#endif
             try {
                 ExecuteModules(pConnection);
             } catch (Delphi::Exception::Exception &E) {
@@ -996,6 +2792,30 @@ namespace Apostol {
 
             return true;
         }
+#ifndef APOSTOL_SERVER_TYPE_TCP
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CModuleProcess::DoAccessLog(CTCPConnection *AConnection) {
+            const auto pConnection = dynamic_cast<CHTTPServerConnection *> (AConnection);
+
+            if (pConnection != nullptr && !pConnection->Request().Method.IsEmpty()) {
+                Metrics().Record(pConnection);
+            }
+
+            CServerProcess::DoAccessLog(AConnection);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CModuleProcess::DoServerDisconnected(CObject *Sender) {
+            const auto pConnection = dynamic_cast<CTCPConnection *> (Sender);
+
+            if (pConnection != nullptr) {
+                Metrics().Unbind(pConnection);
+            }
+
+            CServerProcess::DoServerDisconnected(Sender);
+        }
+#endif
 
         //--------------------------------------------------------------------------------------------------------------
 
@@ -1029,6 +2849,9 @@ namespace Apostol {
                 if (Module->Enabled())
                     DoInitialization(Module);
             }
+#ifndef APOSTOL_SERVER_TYPE_TCP
+            BuildRouteTable();
+#endif
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -1038,6 +2861,11 @@ namespace Apostol {
                 if (Module->Enabled())
                     DoFinalization(Module);
             }
+#ifndef APOSTOL_SERVER_TYPE_TCP
+            m_RouteTable.Clear();
+            m_Fallback.clear();
+            m_Candidates.clear();
+#endif
         }
         //--------------------------------------------------------------------------------------------------------------
 
@@ -1110,6 +2938,34 @@ namespace Apostol {
             }
         }
 #else
+        void CModuleManager::BuildRouteTable() {
+            m_RouteTable.Clear();
+
+            m_Fallback.assign(ModuleCount(), 0);
+            m_Candidates.assign(ModuleCount(), 0);
+
+            for (int i = 0; i < ModuleCount(); i++) {
+                const auto Module = Modules(i);
+
+                if (!Module->Enabled())
+                    continue;
+
+                Module->InitMethodTable();
+
+                const auto &Routes = Module->Routes();
+
+                if (Routes.Count() == 0) {
+                    m_Fallback[i] = 1;
+                    continue;
+                }
+
+                for (int r = 0; r < Routes.Count(); r++) {
+                    m_RouteTable.Add(Routes.Names(r), Routes.ValueFromIndex(r), i);
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
         bool CModuleManager::ExecuteModule(CHTTPServerConnection *AConnection, CApostolModule *AModule) {
             bool Result = AModule->Enabled();
             if (Result) {
@@ -1132,14 +2988,35 @@ namespace Apostol {
                 return;
 
             int Index = 0;
-            while (Index < ModuleCount() && !ExecuteModule(pConnection, Modules(Index))) {
-                Index++;
+
+            if (m_RouteTable.IsEmpty() || m_Candidates.size() != (size_t) ModuleCount()) {
+                while (Index < ModuleCount() && !ExecuteModule(pConnection, Modules(Index))) {
+                    Index++;
+                }
+            } else {
+                const auto &caRequest = pConnection->Request();
+
+                // Modules that did not declare routes are always tried, CheckLocation decides for them
+                m_Candidates = m_Fallback;
+                m_RouteTable.Match(caRequest.Headers[_T("Host")].c_str(), caRequest.Location.pathname.c_str(), m_Candidates);
+
+                while (Index < ModuleCount() && !(m_Candidates[Index] && ExecuteModule(pConnection, Modules(Index)))) {
+                    Index++;
+                }
             }
 
             if (Index == ModuleCount()) {
                 pConnection->SendStockReply(CHTTPReply::not_implemented);
+            } else {
+                Metrics().Bind(pConnection, Index);
             }
         }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CMetrics &CModuleManager::Metrics() {
+            static CMetrics Metrics;
+            return Metrics;
+        }
 #endif
     }
 }
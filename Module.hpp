@@ -26,12 +26,20 @@ Author:
 
 #define APOSTOL_INDEX_FILE "index.html"
 
+#define APOSTOL_GZIP_MIN_LENGTH   256
+#define APOSTOL_GZIP_TICK_BUDGET  (4 * 1024 * 1024)
+#define APOSTOL_GZIP_STALE_TEMP   60
+
+#define APOSTOL_RANGE_MAX_COUNT   16
+#define APOSTOL_RANGE_MAX_WINDOW  (1024 * 1024)
+
 extern "C++" {
 
 namespace Apostol {
 
     namespace Module {
 
+        class CModuleManager;
         class CModuleProcess;
         //--------------------------------------------------------------------------------------------------------------
 
@@ -39,6 +47,14 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         LPCTSTR StrWebTime(time_t Time, LPTSTR lpszBuffer, size_t Size);
+        time_t WebTimeToTime(LPCTSTR lpszTime);
+        //--------------------------------------------------------------------------------------------------------------
+
+        enum CMethodType { mtUnknown = -1, mtOptions = 0, mtGet, mtHead, mtPost, mtPut, mtPatch, mtDelete, mtTrace, mtConnect };
+
+        #define APOSTOL_METHOD_COUNT (mtConnect + 1)
+
+        CMethodType StrToMethodType(LPCTSTR lpszMethod);
 
         //--------------------------------------------------------------------------------------------------------------
 
@@ -67,6 +83,320 @@ namespace Apostol {
             }
         };
 
+#ifndef APOSTOL_SERVER_TYPE_TCP
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CRouteTable -----------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Host -> path prefix trie -> module index. Built once, matched without allocations.
+        class CRouteTable {
+        private:
+
+            struct CRouteNode {
+                TCHAR Char;
+                int Child;
+                int Next;
+                std::vector<int> Modules;
+            };
+
+            struct CRouteHost {
+                CString Host;
+                int Root;
+            };
+
+            std::vector<CRouteNode> m_Nodes;
+            std::vector<CRouteHost> m_Hosts;
+
+            int m_AnyHost;
+
+            int AddNode(TCHAR Char);
+            int FindChild(int Node, TCHAR Char) const;
+            int GetRoot(const CString &Host);
+
+            void MatchRoot(int Root, LPCTSTR lpszPath, std::vector<uint8_t> &Marks) const;
+
+        public:
+
+            CRouteTable();
+
+            void Clear();
+
+            void Add(const CString &Host, const CString &Path, int Module);
+
+            void Match(LPCTSTR lpszHost, LPCTSTR lpszPath, std::vector<uint8_t> &Marks) const;
+
+            bool IsEmpty() const { return m_Nodes.empty(); }
+
+        };
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CLocationMatcher ------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// AllowedLocation() patterns compiled into a segment trie. Matches the path in place, without allocations.
+        class CLocationMatcher {
+        private:
+
+            struct CSegmentNode {
+                CString Segment;
+                int Child;
+                int Next;
+                bool Terminal;
+                int Wildcard;
+            };
+
+            std::vector<CSegmentNode> m_Nodes;
+
+            int AddNode(const CString &Segment);
+            int FindChild(int Node, LPCTSTR lpszSegment, size_t Length) const;
+
+            static size_t SegmentCount(LPCTSTR lpszPath);
+
+        public:
+
+            CLocationMatcher();
+
+            explicit CLocationMatcher(const CStringList &List);
+
+            void Clear();
+
+            void Add(const CString &Pattern);
+            void Compile(const CStringList &List);
+
+            bool Match(LPCTSTR lpszPath) const;
+            bool Match(const CString &Path) const { return Match(Path.c_str()); };
+
+            bool IsEmpty() const { return m_Nodes.size() <= 1; }
+
+        };
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CFileCache ------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        struct CFileInfo {
+            bool Exists = false;
+            bool Directory = false;
+            ino_t Inode = 0;
+            off_t Size = 0;
+            time_t Modified = 0;
+            LPCTSTR ContentType = nullptr;
+        };
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Per-process stat() cache for static resources, including negative lookups.
+        /// Entries are dropped by inotify events on their parent directories.
+        class CFileCache {
+        private:
+
+            pid_t m_Pid;
+
+            int m_Inotify;
+
+            time_t m_Updated;
+
+            CFileInfo m_Info;
+
+            struct CFileEntry {
+                std::string Path;
+                CFileInfo Info;
+            };
+
+            typedef std::list<CFileEntry> CFileEntries;
+
+            /// Most recently used first, the last one is evicted at Config()->FileCacheSize() entries
+            CFileEntries m_Files;
+            std::unordered_map<std::string, CFileEntries::iterator> m_Index;
+
+            std::unordered_map<int, std::string> m_Watches;
+            std::unordered_map<std::string, int> m_Directories;
+
+            void Open();
+            void Close();
+
+            void Erase(const std::string &Path);
+
+            bool Watch(const std::string &Path);
+
+            void Invalidate(const std::string &Directory, LPCTSTR lpszName);
+            void InvalidateDirectory(const std::string &Directory);
+
+            static void FileStat(LPCTSTR lpszPath, CFileInfo &Info);
+
+        public:
+
+            CFileCache();
+
+            ~CFileCache();
+
+            void Clear();
+
+            void Update();
+
+            const CFileInfo &Stat(LPCTSTR lpszPath);
+            const CFileInfo &Stat(const CString &Path) { return Stat(Path.c_str()); };
+
+            bool FileExists(LPCTSTR lpszPath) { const auto &Info = Stat(lpszPath); return Info.Exists && !Info.Directory; };
+            bool DirectoryExists(LPCTSTR lpszPath) { const auto &Info = Stat(lpszPath); return Info.Directory; };
+
+            size_t Count() const { return m_Files.size(); };
+
+        };
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CMemoryCache ----------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Per-process LRU of small static files, bounded by Config()->MemoryCacheSize() bytes
+        class CMemoryCache {
+        private:
+
+            struct CMemoryFile {
+                std::string Path;
+                ino_t Inode;
+                time_t Modified;
+                CString Content;
+            };
+
+            typedef std::list<CMemoryFile> CMemoryFiles;
+
+            CMemoryFiles m_Files;
+            std::unordered_map<std::string, CMemoryFiles::iterator> m_Index;
+
+            size_t m_Size;
+
+        public:
+
+            CMemoryCache();
+
+            void Clear();
+
+            const CString *Find(const CString &Path, const CFileInfo &Info);
+            const CString *Add(const CString &Path, const CFileInfo &Info, CString &Content);
+
+            size_t Size() const { return m_Size; };
+            size_t Count() const { return m_Files.size(); };
+
+        };
+#ifdef WITH_ZLIB
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CGzipCache ------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Compresses static resources into Config()->CachePrefix() on the process timer, a bounded amount per tick
+        class CGzipCache {
+        private:
+
+            struct CJob {
+                std::string Source;
+                std::string Target;
+            };
+
+            std::deque<CJob> m_Queue;
+            std::unordered_set<std::string> m_Pending;
+
+            CJob m_Job;
+
+            int m_Source;
+            gzFile m_Target;
+
+            std::string m_Temp;
+
+            bool Start();
+            void Finish(bool Success);
+
+            static void RemoveStale(const std::string &Target);
+
+        public:
+
+            CGzipCache();
+
+            ~CGzipCache();
+
+            static CString CacheFile(const CString &Resource, time_t Modified);
+
+            void Enqueue(const CString &Source, const CString &Target);
+
+            void Process(size_t Budget);
+
+        };
+#endif
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CMetrics --------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        #define APOSTOL_METRICS_MODULES  32
+        #define APOSTOL_METRICS_NAME     32
+        #define APOSTOL_METRICS_BUCKETS  24
+        #define APOSTOL_METRICS_CLASSES  5
+        #define APOSTOL_METRICS_LOCATION _T("/metrics")
+        #define APOSTOL_STATUS_LOCATION  _T("/status")
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Request counters and latency histograms in shared memory, one slot per process.
+        /// Each slot has a single writer; any process can read all of them to render the text exposition.
+        class CMetrics {
+        private:
+
+            /// Latency buckets are powers of two in microseconds: le = 2^i us, the last one is +Inf
+            struct CModuleMetrics {
+                std::atomic<uint64_t> Requests[APOSTOL_METHOD_COUNT][APOSTOL_METRICS_CLASSES];
+                std::atomic<uint64_t> Buckets[APOSTOL_METRICS_BUCKETS + 1];
+                std::atomic<uint64_t> Sum;
+            };
+
+            struct alignas(64) CSlot {
+                std::atomic<pid_t> Owner;
+                uint32_t Modules;
+                char Names[APOSTOL_METRICS_MODULES][APOSTOL_METRICS_NAME];
+                /// The extra entry counts requests no module accepted
+                CModuleMetrics Data[APOSTOL_METRICS_MODULES + 1];
+            };
+
+            CSlot *m_pSlots;
+            int m_Count;
+
+            CSlot *m_pSlot;
+
+            /// Slot entry of each module of this process, matched by name
+            int m_Index[APOSTOL_METRICS_MODULES];
+
+            std::unordered_map<CTCPConnection *, int> m_Handlers;
+
+        public:
+
+            CMetrics();
+
+            ~CMetrics();
+
+            void Create(int Count);
+            void Destroy();
+
+            bool Attach(const CModuleManager &Manager);
+
+            void Bind(CTCPConnection *AConnection, int Module);
+            void Unbind(CTCPConnection *AConnection);
+            void Record(CHTTPServerConnection *AConnection);
+
+            void Render(CString &Text) const;
+
+            bool Active() const { return m_pSlots != nullptr; }
+            bool Attached() const { return m_pSlot != nullptr; }
+
+        };
+#endif
         //--------------------------------------------------------------------------------------------------------------
 
         //-- CApostolModule --------------------------------------------------------------------------------------------
@@ -78,9 +408,39 @@ namespace Apostol {
 
         enum CModuleStatus { msUnknown = -1, msDisabled, msEnabled };
         //--------------------------------------------------------------------------------------------------------------
+
+        /// Inclusive byte ranges: first and last offset
+        typedef std::vector<std::pair<off_t, off_t>> CByteRanges;
+        //--------------------------------------------------------------------------------------------------------------
 #ifdef WITH_POSTGRESQL
         typedef std::function<void (CHTTPServerConnection *AConnection, CPQPollQuery *APollQuery)> COnApostolModuleSuccessEvent;
         typedef std::function<void (CHTTPServerConnection *AConnection, const Delphi::Exception::Exception &E)> COnApostolModuleFailEvent;
+        typedef std::function<void (CHTTPServerConnection *AConnection, CPQResult *AResult)> COnApostolModuleResultEvent;
+        //--------------------------------------------------------------------------------------------------------------
+#endif
+#ifndef APOSTOL_SERVER_TYPE_TCP
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CSiteEntry ------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Site settings resolved once by InitSites()
+        struct CSiteEntry {
+            /// Index in m_Sites
+            int Index = -1;
+
+            /// Absolute document root without the trailing slash
+            CString Root {};
+
+            struct {
+                CString Identifier {};
+                CString Secret {};
+                CString Callback {};
+                CString Error {};
+                CString Debug {};
+            } OAuth2;
+        };
         //--------------------------------------------------------------------------------------------------------------
 #endif
         class CApostolModule: public CCollectionItem, public CGlobalComponent {
@@ -94,9 +454,25 @@ namespace Apostol {
 #ifndef APOSTOL_SERVER_TYPE_TCP
             CStringPairs m_Sites;
 
+            std::vector<CSiteEntry> m_SiteEntries;
+            std::unordered_multimap<size_t, int> m_SiteHash;
+            int m_DefaultSite;
+
+            static size_t HashHost(LPCTSTR lpszHost, size_t Length);
+
+            int IndexOfSite(LPCTSTR lpszHost, size_t Length) const;
+
+            const CSiteEntry &FindSite(LPCTSTR lpszHost, size_t Length) const;
+
             mutable CString m_AllowedMethods;
             mutable CString m_AllowedHeaders;
 
+            /// Handlers indexed by CMethodType, compiled from m_Methods
+            CMethodHandler *m_MethodTable[APOSTOL_METHOD_COUNT];
+            bool m_MethodTableReady;
+
+            CMethodHandler *FindMethodHandler(const CString &Method) const;
+
             CStringList m_AllowedOrigins;
             bool m_AllowedOriginsLoaded;
 
@@ -114,8 +490,13 @@ namespace Apostol {
 
             CStringList m_Methods { true };
 
+            /// Route prefixes served by the module as "host=path" pairs (empty - use CheckLocation only)
+            CStringList m_Routes;
+
             virtual void InitMethods() abstract;
 
+            void AddRoute(const CString &Path, const CString &Host = _T("*"));
+
             void InitSites(const CSites &Sites);
 
             virtual void DoHead(CHTTPServerConnection *AConnection);
@@ -187,8 +568,13 @@ namespace Apostol {
             static CString GetHost(CHTTPServerConnection *AConnection);
 
             static bool AllowedLocation(const CString &Patch, const CStringList &List);
+            static bool AllowedLocation(const CString &Patch, const CLocationMatcher &Matcher);
+
+            const CString &GetRoot(const CString &Host) const;
+            const CString &GetRoot(CHTTPServerConnection *AConnection) const;
+
+            const CSiteEntry &GetSite(const CString &Host) const;
 
-            CString GetRoot(const CString &Host) const;
             const CString& GetSiteRoot(const CString &Host) const;
             const CStringList& GetSiteConfig(const CString &Host) const;
 
@@ -197,6 +583,10 @@ namespace Apostol {
             CStringList &Methods() { return m_Methods; };
             const CStringList &Methods() const { return m_Methods; };
 
+            const CStringList &Routes() const { return m_Routes; };
+
+            void InitMethodTable();
+
             const CString& AllowedMethods() const { return GetAllowedMethods(); };
             const CString& AllowedHeaders() const { return GetAllowedHeaders(); };
             static void ContentToJson(const CHTTPRequest &Request, CJSON &Json);
@@ -211,6 +601,27 @@ namespace Apostol {
 
             static CString TryFiles(const CString &Root, const CStringList &uris, const CString &Location);
 
+            static CFileCache &FileCache();
+            static CMemoryCache &MemoryCache();
+#ifdef WITH_ZLIB
+            static CGzipCache &GzipCache();
+#endif
+            static bool Compressible(LPCTSTR AContentType);
+            static bool AcceptEncoding(const CString &Value, LPCTSTR ACoding);
+
+            LPCTSTR SelectEncoding(CHTTPServerConnection *AConnection, CString &Resource, const CFileInfo &Info,
+                LPCTSTR AContentType) const;
+
+            static CString GetETag(const CFileInfo &Info, LPCTSTR AEncoding = nullptr);
+            static bool MatchETag(const CString &List, const CString &ETag);
+            static bool NotModified(const CHTTPRequest &Request, const CString &ETag, time_t Modified);
+
+            static bool ParseRange(const CString &Range, off_t Size, CByteRanges &Ranges);
+            static bool ReadRange(int Handle, off_t Offset, size_t Count, CString &Content);
+
+            static bool SendRange(CHTTPServerConnection *AConnection, const CString &Resource, const CFileInfo &Info,
+                const CString &ETag, LPCTSTR AContentType, bool SendNow);
+
             static bool ResourceExists(CString &Resource, const CString &Root, const CString &Path, const CStringList &TryFiles = CStringList());
 
             bool SendResource(CHTTPServerConnection *AConnection, const CString &Path, LPCTSTR AContentType = nullptr,
@@ -229,10 +640,28 @@ namespace Apostol {
                 COnPQPollQueryExecutedEvent && OnExecuted = nullptr, COnPQPollQueryExceptionEvent && OnException = nullptr,
                 const CString &ConfName = {});
 
+            CPQPollQuery *ExecSQL(const CString &Statement, const CSQLParams &Params, CPollConnection *AConnection = nullptr,
+                COnPQPollQueryExecutedEvent && OnExecuted = nullptr, COnPQPollQueryExceptionEvent && OnException = nullptr,
+                const CString &ConfName = {});
+
+            CPQPollQuery *ExecSQL(const CSQLBatch &Batch, CPollConnection *AConnection = nullptr,
+                COnPQPollQueryExecutedEvent && OnExecuted = nullptr, COnPQPollQueryExceptionEvent && OnException = nullptr,
+                const CString &ConfName = {});
+
             CPQPollQuery *ExecuteSQL(const CStringList &SQL, CHTTPServerConnection *AConnection,
                 COnApostolModuleSuccessEvent && OnSuccess, COnApostolModuleFailEvent && OnFail = nullptr,
                 const CString &ConfName = {});
 
+            void QueueSQL(const CString &SQL, CHTTPServerConnection *AConnection,
+                COnApostolModuleResultEvent && OnResult, COnApostolModuleFailEvent && OnFail = nullptr,
+                const CString &ConfName = {}, bool ReadOnly = false);
+
+            void ExecuteCachedSQL(const CString &SQL, CHTTPServerConnection *AConnection, u_int TTL = 0,
+                const CStringList &Channels = {}, const CString &ConfName = {});
+
+            void ExecuteCachedSQL(const CString &Statement, const CSQLParams &Params, CHTTPServerConnection *AConnection,
+                u_int TTL = 0, const CStringList &Channels = {}, const CString &ConfName = {});
+
             static void PQResultToList(CPQResult *Result, CStringList &List);
             static void PQResultToJson(CPQResult *Result, CString &Json, const CString &Format = CString(), const CString &ObjectName = CString());
 #endif
@@ -254,6 +683,13 @@ namespace Apostol {
 #ifdef APOSTOL_SERVER_TYPE_TCP
             bool ExecuteModule(CTCPServerConnection *AConnection, CApostolModule *AModule);
 #else
+            CRouteTable m_RouteTable;
+
+            std::vector<uint8_t> m_Fallback;
+            std::vector<uint8_t> m_Candidates;
+
+            void BuildRouteTable();
+
             bool ExecuteModule(CHTTPServerConnection *AConnection, CApostolModule *AModule);
 #endif
         protected:
@@ -280,7 +716,9 @@ namespace Apostol {
             void ExecuteStreamModules(CUDPAsyncServer *Server, CSocketHandle *Socket, CManagedBuffer &Buffer);
 #endif
             void ExecuteModules(CTCPConnection *AConnection);
-
+#ifndef APOSTOL_SERVER_TYPE_TCP
+            static CMetrics &Metrics();
+#endif
             int ModuleCount() const { return inherited::Count(); }
             void DeleteModule(const int Index) { inherited::Delete(Index); }
 
@@ -308,6 +746,10 @@ namespace Apostol {
             void DoExecuteStream(CUDPAsyncServer *Server, CSocketHandle *Socket, CManagedBuffer &Buffer) override;
 #endif
             bool DoExecute(CTCPConnection *AConnection) override;
+#ifndef APOSTOL_SERVER_TYPE_TCP
+            void DoAccessLog(CTCPConnection *AConnection) override;
+            void DoServerDisconnected(CObject *Sender) override;
+#endif
 
         public:
 
@@ -34,6 +34,11 @@ void signal_error(int signo, siginfo_t *siginfo, void *ucontext) {
     int         trace_size;
     char**      trace_symbols = nullptr;
 
+    CCachedTime::SigSafeUpdate();
+
+    // The process does not return from here: nothing may be left in the ring
+    GLog->Ring().Signal(true);
+
     GLog->Error(APP_LOG_CRIT, 0, "-----BEGIN BACKTRACE LOG-----");
     GLog->Error(APP_LOG_CRIT, 0, "Signal             : %d (%s)", signo, strsignal(signo));
     GLog->Error(APP_LOG_CRIT, 0, "Fault address      : %p", siginfo->si_addr);
@@ -113,6 +118,7 @@ namespace Apostol {
             sig_reopen = 0;
             sig_noaccept = 0;
             sig_change_binary = 0;
+            sig_status = 0;
 
             sig_exiting = 0;
             sig_restart = 0;
@@ -222,6 +228,7 @@ namespace Apostol {
                 AddSignal(signal_value(SIG_REOPEN_SIGNAL), "SIG" sig_value(SIG_REOPEN_SIGNAL), "reopen", nullptr);
                 AddSignal(signal_value(SIG_TERMINATE_SIGNAL), "SIG" sig_value(SIG_TERMINATE_SIGNAL), "stop", nullptr);
                 AddSignal(signal_value(SIG_SHUTDOWN_SIGNAL), "SIG" sig_value(SIG_SHUTDOWN_SIGNAL), "quit", nullptr);
+                AddSignal(SIGTTIN, "SIGTTIN", "status", nullptr);
 
             } else {
 
@@ -243,6 +250,8 @@ namespace Apostol {
                 AddSignal(signal_value(SIG_CHANGEBIN_SIGNAL), "SIG" sig_value(SIG_CHANGEBIN_SIGNAL),
                           "", signal_handler);
 
+                AddSignal(SIGTTIN, "SIGTTIN", "status", signal_handler);
+
                 AddSignal(SIGINT, "SIGINT", nullptr, signal_handler);
 
                 AddSignal(SIGIO, "SIGIO", nullptr, signal_handler);
@@ -280,6 +289,12 @@ namespace Apostol {
 
             err = errno;
 
+            // The cached time is refreshed by the event loop, which is not running while the handler is
+            CCachedTime::SigSafeUpdate();
+
+            const auto in_signal = Log()->Ring().Signal();
+            Log()->Ring().Signal(true);
+
             int i = IndexOfSigNo(signo);
             if (i >= 0)
                 sigcode = Signals(i)->Code();
@@ -348,6 +363,11 @@ namespace Apostol {
                             action = _T(", alarm");
                             break;
 
+                        case SIGTTIN:
+                            sig_status = 1;
+                            action = _T(", dumping status");
+                            break;
+
                         case SIGIO:
                             sig_sigio = 1;
                             break;
@@ -398,6 +418,7 @@ namespace Apostol {
 #endif
                             break;
                         case signal_value(SIG_CHANGEBIN_SIGNAL):
+                        case SIGTTIN:
                         case SIGIO:
                             action = _T(", ignoring");
                             break;
@@ -432,6 +453,8 @@ namespace Apostol {
                 ChildProcessGetStatus();
             }
 
+            Log()->Ring().Signal(in_signal);
+
             errno = err;
         }
         //--------------------------------------------------------------------------------------------------------------
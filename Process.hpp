@@ -81,6 +81,7 @@ namespace Apostol {
             sig_atomic_t    sig_reopen;
             sig_atomic_t    sig_noaccept;
             sig_atomic_t    sig_change_binary;
+            sig_atomic_t    sig_status;
 
             uint_t          sig_exiting;
             uint_t          sig_restart;
@@ -34,6 +34,703 @@ namespace Apostol {
 
         //--------------------------------------------------------------------------------------------------------------
 
+        //-- CScoreboard -----------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        CScoreboard::CScoreboard(): m_pSlots(nullptr), m_Count(0), m_pSlot(nullptr), m_Mark(0), m_MarkTime(0) {
+
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CScoreboard::~CScoreboard() {
+            Destroy();
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CScoreboard::Create(int Count) {
+            Destroy();
+
+            const auto Size = sizeof(CSlot) * Count;
+
+            const auto pArea = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (pArea == MAP_FAILED)
+                throw EOSError(errno, _T("mmap(%lu) for the scoreboard failed"), (unsigned long) Size);
+
+            m_pSlots = (CSlot *) pArea;
+            m_Count = Count;
+
+            for (int i = 0; i < Count; ++i) {
+                new (m_pSlots + i) CSlot();
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CScoreboard::Destroy() {
+            if (m_pSlots != nullptr) {
+                munmap(m_pSlots, sizeof(CSlot) * m_Count);
+                m_pSlots = nullptr;
+                m_Count = 0;
+            }
+            m_pSlot = nullptr;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CScoreboard::Attach(LPCTSTR AName) {
+            if (m_pSlots == nullptr)
+                return false;
+
+            const auto pid = getpid();
+
+            for (int i = 0; i < m_Count; ++i) {
+                auto &Slot = m_pSlots[i];
+
+                pid_t Current = Slot.Pid.load();
+                if (Current == 0 || (Current != pid && kill(Current, 0) == -1 && errno == ESRCH)) {
+                    if (Slot.Pid.compare_exchange_strong(Current, pid)) {
+                        ::strncpy(Slot.Name, AName, sizeof(Slot.Name) - 1);
+                        Slot.Name[sizeof(Slot.Name) - 1] = '\0';
+
+                        Slot.Started = CCachedTime::Seconds();
+                        Slot.Updated = Slot.Started;
+                        Slot.Loops = 0;
+                        Slot.Requests = 0;
+                        Slot.Rate = 0;
+                        Slot.Connections = 0;
+                        Slot.Queries = 0;
+
+                        m_pSlot = &Slot;
+                        m_Mark = 0;
+                        m_MarkTime = Slot.Started;
+
+                        return true;
+                    }
+                }
+            }
+
+            m_pSlot = nullptr;
+            return false;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CScoreboard::Update(uint64_t Requests, uint32_t Connections, uint32_t Queries) {
+            if (m_pSlot == nullptr)
+                return;
+
+            const auto Now = CCachedTime::Seconds();
+
+            m_pSlot->Loops.store(m_pSlot->Loops.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            m_pSlot->Requests.store(Requests, std::memory_order_relaxed);
+            m_pSlot->Connections.store(Connections, std::memory_order_relaxed);
+            m_pSlot->Queries.store(Queries, std::memory_order_relaxed);
+
+            if (Now != m_MarkTime) {
+                m_pSlot->Rate.store((uint32_t) ((Requests - m_Mark) / (Now - m_MarkTime)), std::memory_order_relaxed);
+                m_Mark = Requests;
+                m_MarkTime = Now;
+            }
+
+            m_pSlot->Updated.store(Now, std::memory_order_relaxed);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CScoreboard::Render(CString &Text) const {
+            TCHAR szLine[MAX_BUFFER_SIZE + 1];
+
+            const auto Now = CCachedTime::Seconds();
+
+            Text << "pid\tname\tuptime\tidle\tloops\trequests\trps\tconnections\tqueries\n";
+
+            for (int i = 0; i < m_Count; ++i) {
+                const auto &Slot = m_pSlots[i];
+
+                const auto pid = Slot.Pid.load();
+                if (pid == 0 || (kill(pid, 0) == -1 && errno == ESRCH))
+                    continue;
+
+                ::snprintf(szLine, sizeof(szLine), "%d\t%s\t%ld\t%ld\t%llu\t%llu\t%u\t%u\t%u\n",
+                           (int) pid, Slot.Name,
+                           (long) (Now - Slot.Started),
+                           (long) (Now - Slot.Updated.load(std::memory_order_relaxed)),
+                           (unsigned long long) Slot.Loops.load(std::memory_order_relaxed),
+                           (unsigned long long) Slot.Requests.load(std::memory_order_relaxed),
+                           Slot.Rate.load(std::memory_order_relaxed),
+                           Slot.Connections.load(std::memory_order_relaxed),
+                           Slot.Queries.load(std::memory_order_relaxed));
+
+                Text << szLine;
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CScoreboard::Dump() const {
+            const auto Now = CCachedTime::Seconds();
+
+            for (int i = 0; i < m_Count; ++i) {
+                const auto &Slot = m_pSlots[i];
+
+                const auto pid = Slot.Pid.load();
+                if (pid == 0 || (kill(pid, 0) == -1 && errno == ESRCH))
+                    continue;
+
+                Log()->Notice(_T("status: %P %s uptime: %ld idle: %ld loops: %llu requests: %llu rps: %u connections: %u queries: %u"),
+                              pid, Slot.Name,
+                              (long) (Now - Slot.Started),
+                              (long) (Now - Slot.Updated.load(std::memory_order_relaxed)),
+                              (unsigned long long) Slot.Loops.load(std::memory_order_relaxed),
+                              (unsigned long long) Slot.Requests.load(std::memory_order_relaxed),
+                              Slot.Rate.load(std::memory_order_relaxed),
+                              Slot.Connections.load(std::memory_order_relaxed),
+                              Slot.Queries.load(std::memory_order_relaxed));
+            }
+        }
+#ifdef WITH_POSTGRESQL
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CSQLBinder ------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CSQLBinder::Scan(const CString &SQL, CScan &Result) {
+
+            auto is_ident = [](char ch) { return isalnum((unsigned char) ch) || ch == '_'; };
+
+            const char *sql = SQL.c_str();
+            const size_t size = SQL.Size();
+
+            size_t start = 0;
+            size_t i = 0;
+
+            bool content = false;
+
+            Result.Params = 0;
+            Result.Statements = 0;
+            Result.Into = false;
+            Result.Words.clear();
+            Result.Fragments.clear();
+
+            while (i < size) {
+                const char ch = sql[i];
+
+                const bool comment = (ch == '-' && i + 1 < size && sql[i + 1] == '-') ||
+                                     (ch == '/' && i + 1 < size && sql[i + 1] == '*');
+
+                if (ch == ';') {
+                    if (content)
+                        Result.Statements++;
+                    content = false;
+                } else if (!comment && !isspace((unsigned char) ch)) {
+                    content = true;
+                }
+
+                if (ch == '\'') {
+                    const bool escape = i > 0 && (sql[i - 1] == 'E' || sql[i - 1] == 'e');
+                    i++;
+                    while (i < size && sql[i] != '\'') {
+                        i += (escape && sql[i] == '\\') ? 2 : 1;
+                    }
+                    i++;
+                } else if (ch == '"') {
+                    i++;
+                    while (i < size && sql[i] != '"')
+                        i++;
+                    i++;
+                } else if (ch == '-' && i + 1 < size && sql[i + 1] == '-') {
+                    while (i < size && sql[i] != '\n')
+                        i++;
+                } else if (ch == '/' && i + 1 < size && sql[i + 1] == '*') {
+                    const char *end = strstr(sql + i + 2, "*/");
+                    i = end == nullptr ? size : end - sql + 2;
+                } else if (ch == '$' && i + 1 < size && isdigit((unsigned char) sql[i + 1])) {
+                    size_t j = i + 1;
+                    int n = 0;
+                    while (j < size && isdigit((unsigned char) sql[j])) {
+                        n = n * 10 + (sql[j++] - '0');
+                        if (n > APOSTOL_SQL_PARAMS_MAX)
+                            throw Delphi::Exception::ExceptionFrm(_T("ExecSQL: Parameter number out of range (max $%d)."),
+                                                                  APOSTOL_SQL_PARAMS_MAX);
+                    }
+
+                    if (n > 0 && (i == 0 || !is_ident(sql[i - 1]))) {
+                        Result.Fragments.push_back({start, i - start, n});
+                        Result.Params = std::max(Result.Params, n);
+                        start = j;
+                    }
+
+                    i = j;
+                } else if (ch == '$' && (i == 0 || !is_ident(sql[i - 1]))) {
+                    // Dollar-quoted string: $tag$ ... $tag$
+                    size_t j = i + 1;
+                    while (j < size && is_ident(sql[j]))
+                        j++;
+
+                    if (j < size && sql[j] == '$') {
+                        const std::string tag(sql + i, j - i + 1);
+                        const char *end = strstr(sql + j + 1, tag.c_str());
+                        i = end == nullptr ? size : end - sql + tag.size();
+                    } else {
+                        i++;
+                    }
+                } else if (isalpha((unsigned char) ch) || ch == '_') {
+                    size_t j = i + 1;
+                    while (j < size && is_ident(sql[j]))
+                        j++;
+
+                    if (Result.Statements == 0) {
+                        if (Result.Words.size() < 8) {
+                            std::string word(sql + i, j - i);
+                            std::transform(word.begin(), word.end(), word.begin(), ::toupper);
+                            Result.Words.push_back(word);
+                        }
+
+                        // SELECT ... INTO creates a table
+                        if (j - i == 4 && strncasecmp(sql + i, "into", 4) == 0)
+                            Result.Into = true;
+                    }
+
+                    i = j;
+                } else {
+                    i++;
+                }
+            }
+
+            if (content)
+                Result.Statements++;
+
+            Result.Fragments.push_back({start, size - start, 0});
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CSQLBinder::IsReadOnly(const CScan &Scan) {
+            if (Scan.Words.empty() || Scan.Into)
+                return false;
+
+            const auto &First = Scan.Words[0];
+
+            return First == "SELECT" || First == "VALUES" || First == "TABLE" || First == "SHOW";
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CSQLBinder::IsTransactional(const CScan &Scan) {
+            const auto &Words = Scan.Words;
+
+            if (Words.empty())
+                return true;
+
+            const auto &First = Words[0];
+            const auto Second = Words.size() > 1 ? Words[1] : std::string();
+
+            if (First == "VACUUM")
+                return false;
+
+            // Transaction control would end the implicit transaction of the batch
+            if (First == "BEGIN" || First == "START" || First == "COMMIT" || First == "END" ||
+                First == "ROLLBACK" || First == "ABORT" || First == "SAVEPOINT" || First == "RELEASE")
+                return false;
+
+            if ((First == "CREATE" || First == "DROP") && (Second == "DATABASE" || Second == "TABLESPACE"))
+                return false;
+
+            if (First == "ALTER" && Second == "SYSTEM")
+                return false;
+
+            if (First == "REINDEX" && (Second == "SYSTEM" || Second == "DATABASE"))
+                return false;
+
+            if (First == "CREATE" || First == "DROP" || First == "REINDEX") {
+                for (const auto &Word : Words) {
+                    if (Word == "CONCURRENTLY")
+                        return false;
+                }
+            }
+
+            return true;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CSQLBinder::SafeEncoding(const CString &Encoding) {
+            static LPCSTR Unsafe[] = { "sjis", "shiftjis", "mskanji", "win932", "shiftjis2004", "big5", "win950",
+                                       "gbk", "win936", "gb18030", "uhc", "win949", "johab", "win1361" };
+
+            // As clean_encoding_name() of Postgres: case and punctuation do not count
+            std::string Name;
+            for (size_t i = 0; i < Encoding.Length(); i++) {
+                if (isalnum((unsigned char) Encoding[i]))
+                    Name += (char) tolower((unsigned char) Encoding[i]);
+            }
+
+            for (const auto *Item : Unsafe) {
+                if (Name == Item)
+                    return false;
+            }
+
+            return true;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CSQLBinder::Bind(const CString &SQL, const CSQLParams &Params, CString &Result, const CString &Encoding) {
+            static const char hex[] = "0123456789abcdef";
+
+            if (!SafeEncoding(Encoding))
+                throw Delphi::Exception::ExceptionFrm(_T("ExecSQL: Bound parameters cannot be escaped for client_encoding \"%s\"."),
+                                                      Encoding.c_str());
+
+            CScan Scan;
+            CSQLBinder::Scan(SQL, Scan);
+
+            if (Scan.Params > (int) Params.size())
+                throw Delphi::Exception::ExceptionFrm(_T("ExecSQL: Statement expects %d parameter(s), %d given."),
+                                                      Scan.Params, (int) Params.size());
+
+            const char *sql = SQL.c_str();
+
+            for (const auto &Fragment : Scan.Fragments) {
+                Result.Append(sql + Fragment.Offset, Fragment.Length);
+
+                if (Fragment.Param == 0)
+                    continue;
+
+                const auto &Param = Params[Fragment.Param - 1];
+
+                if (Param.Null) {
+                    Result << "NULL";
+                } else if (Param.Binary) {
+                    Result << "E'\\\\x";
+                    const auto *p = (const unsigned char *) Param.Value.c_str();
+                    for (size_t i = 0; i < Param.Value.Size(); i++) {
+                        const char byte[2] = { hex[p[i] >> 4], hex[p[i] & 0x0f] };
+                        Result.Append(byte, 2);
+                    }
+                    Result << "'";
+                } else {
+                    // SafeEncoding(): no multibyte sequence ends in a 0x5c or 0x27 byte
+                    const char *value = Param.Value.c_str();
+                    const size_t length = Param.Value.Size();
+
+                    Result << "E'";
+
+                    size_t from = 0;
+                    for (size_t i = 0; i < length; i++) {
+                        if (value[i] == '\'' || value[i] == '\\') {
+                            Result.Append(value + from, i - from);
+                            Result.Append(value[i] == '\'' ? "''" : "\\\\", 2);
+                            from = i + 1;
+                        }
+                    }
+
+                    Result.Append(value + from, length - from);
+                    Result << "'";
+                }
+
+                if (!Param.Type.IsEmpty()) {
+                    Result << "::" << Param.Type;
+                }
+            }
+        }
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CSQLBatch -------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        int CSQLBatch::Add(const CString &Statement) {
+            CSQLBinder::CScan Scan;
+            CSQLBinder::Scan(Statement, Scan);
+
+            if (Scan.Statements == 0)
+                throw Delphi::Exception::Exception(_T("SQL batch: Empty statement."));
+
+            // Results(i) maps to entries only while every entry is exactly one statement
+            if (Scan.Statements > 1)
+                throw Delphi::Exception::Exception(_T("SQL batch: One statement per entry expected."));
+
+            if (!CSQLBinder::IsTransactional(Scan))
+                m_Transactional = false;
+
+            const char *sql = Statement.c_str();
+
+            size_t length = Statement.Size();
+            while (length > 0 && (sql[length - 1] == ';' || isspace((unsigned char) sql[length - 1])))
+                length--;
+
+            if (length == Statement.Size())
+                return m_SQL.Add(Statement);
+
+            return m_SQL.Add(Statement.SubString(0, length));
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        int CSQLBatch::Add(const CString &Statement, const CSQLParams &Params) {
+            CString Text;
+            CSQLBinder::Bind(Statement, Params, Text);
+            m_Bound = true;
+            return Add(Text);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CSQLBatch::Pack(CStringList &SQL) const {
+            if (m_SQL.Count() == 1) {
+                SQL.Add(m_SQL[0]);
+                return;
+            }
+
+            if (!m_Transactional)
+                throw Delphi::Exception::Exception(_T("SQL batch: Statement cannot run inside a transaction block."));
+
+            // The terminator goes on its own line so a trailing "--" comment cannot swallow it
+            CString Text;
+            for (int i = 0; i < m_SQL.Count(); i++) {
+                Text << m_SQL[i] << "\n;\n";
+            }
+
+            SQL.Add(Text);
+        }
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CQueryCache -----------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        CQueryCache::CQueryCache() {
+            m_Version = 0;
+            m_Size = 0;
+            m_Hits = 0;
+            m_Misses = 0;
+            m_Evictions = 0;
+            m_Invalidations = 0;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        size_t CQueryCache::Hash(const CString &ConfName, const CString &SQL) {
+            // FNV-1a over ConfName, a zero byte, then SQL
+            size_t hash = 14695981039346656037ULL;
+
+            auto update = [&hash](const CString &S) {
+                const auto *p = (const unsigned char *) S.c_str();
+                for (size_t i = 0; i < S.Size(); i++) {
+                    hash ^= p[i];
+                    hash *= 1099511628211ULL;
+                }
+            };
+
+            update(ConfName);
+            hash *= 1099511628211ULL;
+            update(SQL);
+
+            return hash;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CQueryCache::Delete(CEntryList::iterator It) {
+            m_Size -= It->Size;
+            m_Index.erase(It->Hash);
+            m_List.erase(It);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        const CString *CQueryCache::Find(const CString &ConfName, const CString &SQL) {
+            if (Config()->QueryCacheSize() == 0)
+                return nullptr;
+
+            const auto it = m_Index.find(Hash(ConfName, SQL));
+
+            if (it == m_Index.end() || it->second->SQL != SQL || it->second->ConfName != ConfName) {
+                m_Misses++;
+                return nullptr;
+            }
+
+            if (it->second->Expires <= CCachedTime::Seconds()) {
+                Delete(it->second);
+                m_Misses++;
+                return nullptr;
+            }
+
+            m_List.splice(m_List.begin(), m_List, it->second);
+            m_Hits++;
+
+            return &m_List.front().Content;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CQueryCache::Add(const CString &ConfName, const CString &SQL, const CString &Content, u_int TTL,
+                const CStringList &Channels, uint64_t Version) {
+
+            const auto budget = Config()->QueryCacheSize();
+            const auto size = sizeof(CEntry) + ConfName.Size() + SQL.Size() + Content.Size();
+
+            if (TTL == 0 || size > budget / 4)
+                return;
+
+            // Not covered by a working LISTEN, or invalidated while the query was running
+            if (Version != m_Version || !Confirmed(ConfName, Channels))
+                return;
+
+            const auto hash = Hash(ConfName, SQL);
+
+            const auto it = m_Index.find(hash);
+            if (it != m_Index.end())
+                Delete(it->second);
+
+            while (!m_List.empty() && m_Size + size > budget) {
+                Delete(std::prev(m_List.end()));
+                m_Evictions++;
+            }
+
+            m_List.emplace_front();
+
+            auto &Entry = m_List.front();
+
+            Entry.Hash = hash;
+            Entry.ConfName = ConfName;
+            Entry.SQL = SQL;
+            Entry.Content = Content;
+            Entry.Channels = Channels;
+            Entry.Expires = CCachedTime::Seconds() + TTL;
+            Entry.Size = size;
+
+            m_Index[hash] = m_List.begin();
+            m_Size += size;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        std::string CQueryCache::ChannelKey(const CString &ConfName, const CString &Channel) {
+            std::string key(ConfName.c_str());
+            key.append(1, '\0').append(Channel.c_str());
+            return key;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CQueryCache::Subscribe(const CString &ConfName, const CString &Channel) {
+            return m_Channels.emplace(ChannelKey(ConfName, Channel), false).second;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CQueryCache::Subscribed(const CString &ConfName, const CString &Channel, CPQConnection *AConnection) {
+            m_Channels[ChannelKey(ConfName, Channel)] = true;
+            m_Listeners[ConfName.c_str()] = AConnection;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CQueryCache::Unsubscribed(const CString &ConfName, const CString &Channel) {
+            m_Channels.erase(ChannelKey(ConfName, Channel));
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CQueryCache::Confirmed(const CString &ConfName, const CStringList &Channels) const {
+            for (int i = 0; i < Channels.Count(); i++) {
+                const auto it = m_Channels.find(ChannelKey(ConfName, Channels[i]));
+                if (it == m_Channels.end() || !it->second)
+                    return false;
+            }
+            return true;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CQueryCache::Invalidate(LPCSTR Channel) {
+            m_Version++;
+
+            auto it = m_List.begin();
+            while (it != m_List.end()) {
+                const auto next = std::next(it);
+                for (int i = 0; i < it->Channels.Count(); i++) {
+                    if (it->Channels[i] == Channel) {
+                        Delete(it);
+                        m_Invalidations++;
+                        break;
+                    }
+                }
+                it = next;
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CQueryCache::Disconnected(CPQConnection *AConnection) {
+            auto listener = m_Listeners.begin();
+            while (listener != m_Listeners.end()) {
+                if (listener->second != AConnection) {
+                    ++listener;
+                    continue;
+                }
+
+                // The LISTENs went with the connection: notifications for this configuration are lost from now on
+                const auto &ConfName = listener->first;
+                const auto prefix = ConfName + '\0';
+
+                auto channel = m_Channels.begin();
+                while (channel != m_Channels.end()) {
+                    if (channel->first.compare(0, prefix.size(), prefix) == 0) {
+                        channel = m_Channels.erase(channel);
+                    } else {
+                        ++channel;
+                    }
+                }
+
+                auto it = m_List.begin();
+                while (it != m_List.end()) {
+                    const auto next = std::next(it);
+                    if (it->Channels.Count() != 0 && ConfName == it->ConfName.c_str()) {
+                        Delete(it);
+                        m_Invalidations++;
+                    }
+                    it = next;
+                }
+
+                m_Version++;
+
+                listener = m_Listeners.erase(listener);
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CQueryCache::Clear() {
+            m_Index.clear();
+            m_List.clear();
+            m_Channels.clear();
+            m_Listeners.clear();
+            m_Version++;
+            m_Size = 0;
+        }
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CSQLQueue -------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CSQLQueue::Add(const CString &ConfName, CItem &&Item) {
+            for (auto &Group : m_Pending) {
+                if (Group.ConfName == ConfName) {
+                    Group.Items.push_back(std::move(Item));
+                    return;
+                }
+            }
+
+            m_Pending.emplace_back();
+            m_Pending.back().ConfName = ConfName;
+            m_Pending.back().Items.push_back(std::move(Item));
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CSQLQueue::Unbind(CPollConnection *AConnection) {
+            for (auto &Group : m_Pending) {
+                for (auto &Item : Group.Items) {
+                    if (Item.Binding == AConnection)
+                        Item.Binding = nullptr;
+                }
+            }
+
+            for (auto &Items : m_Running) {
+                for (auto &Item : Items) {
+                    if (Item.Binding == AConnection)
+                        Item.Binding = nullptr;
+                }
+            }
+        }
+#endif
+        //--------------------------------------------------------------------------------------------------------------
+
         //-- CServerProcess --------------------------------------------------------------------------------------------
 
         //--------------------------------------------------------------------------------------------------------------
@@ -41,6 +738,11 @@ namespace Apostol {
         CServerProcess::CServerProcess() {
             m_pTimer = nullptr;
             m_TimerInterval = 0;
+            m_AccessCounter = 0;
+
+            m_Requests = 0;
+            m_Connections = 0;
+            m_Queries = 0;
 
             m_EventHandlers.PollStack().TimeOut(Config()->TimeOut());
 
@@ -215,6 +917,23 @@ namespace Apostol {
         }
         //--------------------------------------------------------------------------------------------------------------
 
+        void CServerProcess::SetReusePort(CSocketHandles *ABindings, int ASocketType, int AProtocol) {
+            const int on = 1;
+
+            for (int i = 0; i < ABindings->Count(); i++) {
+                const auto pHandle = ABindings->Handles(i);
+
+                if (!pHandle->HandleAllocated()) {
+                    pHandle->AllocateSocket(ASocketType, AProtocol);
+                }
+
+                if (::setsockopt(pHandle->Handle(), SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1) {
+                    throw EOSError(errno, _T("setsockopt(SO_REUSEPORT) failed"));
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
         void CServerProcess::InitializeServer(const CString &Title, const CString &Listen, u_short Port) {
             m_Server.ServerName() = Title;
 
@@ -225,6 +944,11 @@ namespace Apostol {
             LoadProviders(m_Server.Providers());
 #endif
             m_Server.InitializeBindings();
+
+            if (Config()->ReusePort()) {
+                SetReusePort(m_Server.Bindings(), SOCK_STREAM, IPPROTO_TCP);
+            }
+
             m_Server.ActiveLevel(alBinding);
 #ifdef APOSTOL_SERVER_TYPE_TCP
             Log()->Notice("[TCP] Listening at: %s:%d", Listen.c_str(), Port);
@@ -238,6 +962,11 @@ namespace Apostol {
             m_StreamServer.DefaultPort(Port);
 
             m_StreamServer.InitializeBindings();
+
+            if (Config()->ReusePort()) {
+                SetReusePort(m_StreamServer.Bindings(), SOCK_DGRAM, IPPROTO_UDP);
+            }
+
             m_StreamServer.ActiveLevel(alBinding);
 
             Log()->Notice("[UDP] Listening at: %s:%d", Listen.c_str(), Port);
@@ -291,6 +1020,26 @@ namespace Apostol {
         }
         //--------------------------------------------------------------------------------------------------------------
 
+        CString CServerProcess::ClientEncoding(const CString &ConfName) const {
+            const auto &Name = ConfName.IsEmpty() ? m_ConfName : ConfName;
+            const auto &ConnInfo = Config()->PostgresConnInfo();
+
+            for (int i = 0; i < ConnInfo.Count(); i++) {
+                if (ConnInfo[i].Name() == Name) {
+                    const auto &Encoding = ConnInfo[i].Value().Values("client_encoding");
+                    if (!Encoding.IsEmpty())
+                        return Encoding;
+                    break;
+                }
+            }
+
+            // libpq falls back to the environment, then to the server encoding
+            const auto lpszEnv = getenv("PGCLIENTENCODING");
+
+            return lpszEnv == nullptr ? CString() : CString(lpszEnv);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
         void CServerProcess::InitializePQClients(const CString &Title, u_int Min, u_int Max) {
             for (int i = 0; i < Config()->PostgresConnInfo().Count(); i++) {
                 const auto &caPostgresConnInfo = Config()->PostgresConnInfo()[i];
@@ -303,6 +1052,18 @@ namespace Apostol {
 
                 PQClient.AllocateEventHandlers(Server());
                 InitializePQClientHandlers(PQClient);
+
+                // One dedicated connection for LISTEN: notifications arrive only where LISTEN ran.
+                // Started on first use by GetQuery().
+                const auto listener = m_PQClients.AddPair(caPostgresConnInfo.Name() + APOSTOL_PQ_LISTENER_SUFFIX, CPQClient(1, 1));
+
+                auto &PQListener = m_PQClients[listener].Value();
+
+                PQListener.ConnInfo().ApplicationName() = "'" + Title + "'";
+                PQListener.ConnInfo().SetParameters(caPostgresConnInfo.Value());
+
+                PQListener.AllocateEventHandlers(Server());
+                InitializePQClientHandlers(PQListener);
             }
         }
         //--------------------------------------------------------------------------------------------------------------
@@ -331,6 +1092,17 @@ namespace Apostol {
         }
         //--------------------------------------------------------------------------------------------------------------
 
+        CScoreboard &CServerProcess::Scoreboard() {
+            static CScoreboard Scoreboard;
+            return Scoreboard;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CServerProcess::UpdateScoreboard() const {
+            Scoreboard().Update(m_Requests, m_Connections, m_Queries);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
         void CServerProcess::Reload() {
             Config()->Reload();
 #ifndef APOSTOL_SERVER_TYPE_TCP
@@ -438,7 +1210,241 @@ namespace Apostol {
         }
         //--------------------------------------------------------------------------------------------------------------
 
+        CPQPollQuery *CServerProcess::ExecSQL(const CString &Statement, const CSQLParams &Params,
+                CPollConnection *AConnection, COnPQPollQueryExecutedEvent &&OnExecuted,
+                COnPQPollQueryExceptionEvent &&OnException, const CString &ConfName) {
+
+            CString Text;
+            CSQLBinder::Bind(Statement, Params, Text, ClientEncoding(ConfName));
+
+            CStringList SQL;
+            SQL.Add(Text);
+
+            return ExecSQL(SQL, AConnection, static_cast<COnPQPollQueryExecutedEvent &&>(OnExecuted),
+                static_cast<COnPQPollQueryExceptionEvent &&>(OnException), ConfName);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CPQPollQuery *CServerProcess::ExecSQL(const CSQLBatch &Batch, CPollConnection *AConnection,
+                COnPQPollQueryExecutedEvent &&OnExecuted, COnPQPollQueryExceptionEvent &&OnException,
+                const CString &ConfName) {
+
+            if (Batch.Count() == 0)
+                throw Delphi::Exception::Exception(_T("ExecSQL: SQL batch is empty."));
+
+            if (Batch.Bound() && !CSQLBinder::SafeEncoding(ClientEncoding(ConfName)))
+                throw Delphi::Exception::ExceptionFrm(_T("ExecSQL: Bound parameters cannot be escaped for client_encoding \"%s\"."),
+                                                      ClientEncoding(ConfName).c_str());
+
+            CStringList SQL;
+            Batch.Pack(SQL);
+
+            return ExecSQL(SQL, AConnection, static_cast<COnPQPollQueryExecutedEvent &&>(OnExecuted),
+                static_cast<COnPQPollQueryExceptionEvent &&>(OnException), ConfName);
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CServerProcess::QueueSQL(const CString &SQL, CPollConnection *AConnection,
+                COnSQLQueueExecutedEvent &&OnExecuted, COnSQLQueueExceptionEvent &&OnException,
+                const CString &ConfName, bool ReadOnly) {
+
+            CSQLBinder::CScan Scan;
+            CSQLBinder::Scan(SQL, Scan);
+
+            // One result per caller: anything else would hand other clients someone else's rows
+            if (Scan.Statements != 1)
+                throw Delphi::Exception::Exception(_T("QueueSQL: Exactly one statement expected."));
+
+            CSQLQueue::CItem Item = { SQL, AConnection, AConnection != nullptr,
+                static_cast<COnSQLQueueExecutedEvent &&>(OnExecuted),
+                static_cast<COnSQLQueueExceptionEvent &&>(OnException) };
+
+            // Only statements the caller declared read-only share a batch: the first keyword proves nothing,
+            // "SELECT api.fn()" writes, and a batch that fails is run again statement by statement.
+            // IsReadOnly() only keeps an obvious write from being batched by mistake
+            if (!Config()->PostgresBatch() || !ReadOnly || !CSQLBinder::IsReadOnly(Scan)) {
+                CSQLQueue::CItems Items;
+                Items.push_back(std::move(Item));
+                SendSQL(ConfName, std::move(Items));
+                return;
+            }
+
+            m_SQLQueue.Add(ConfName, std::move(Item));
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CServerProcess::FlushSQL() {
+            if (m_SQLQueue.Empty())
+                return;
+
+            const auto size = std::max(Config()->PostgresBatchSize(), (size_t) 1);
+
+            // Callbacks may queue statements of their own: those go out on the next cycle
+            std::vector<CSQLQueue::CGroup> Pending;
+            Pending.swap(m_SQLQueue.Pending());
+
+            for (auto &Group : Pending) {
+                auto &Items = Group.Items;
+
+                for (size_t from = 0; from < Items.size(); from += size) {
+                    const auto to = std::min(from + size, Items.size());
+
+                    SendSQL(Group.ConfName, CSQLQueue::CItems(std::make_move_iterator(Items.begin() + (long) from),
+                                                              std::make_move_iterator(Items.begin() + (long) to)));
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CServerProcess::SendSQL(const CString &ConfName, CSQLQueue::CItems &&Items) {
+            auto &Running = m_SQLQueue.Running();
+
+            Running.push_back(std::move(Items));
+
+            const auto it = std::prev(Running.end());
+
+            auto OnExecuted = [this, it, ConfName](CPQPollQuery *APollQuery) {
+                if (it->size() > 1 && !CheckSQLBatch(APollQuery, (int) it->size())) {
+                    RetrySQL(ConfName, *it);
+                } else {
+                    DoSQLQueueExecuted(APollQuery, *it);
+                }
+                m_SQLQueue.Running().erase(it);
+            };
+
+            auto OnException = [this, it, ConfName](CPQPollQuery *APollQuery, const Delphi::Exception::Exception &E) {
+                if (it->size() > 1) {
+                    RetrySQL(ConfName, *it);
+                } else {
+                    DoSQLQueueException(*it, E);
+                }
+                m_SQLQueue.Running().erase(it);
+            };
+
+            try {
+                CSQLBatch Batch;
+                for (const auto &Item : *it)
+                    Batch.Add(Item.SQL);
+
+                ExecSQL(Batch, nullptr, OnExecuted, OnException, ConfName);
+            } catch (Delphi::Exception::Exception &E) {
+                DoSQLQueueException(*it, E);
+                Running.erase(it);
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        bool CServerProcess::CheckSQLBatch(CPQPollQuery *APollQuery, int Count) {
+            if (APollQuery->ResultCount() < Count)
+                return false;
+
+            for (int i = 0; i < Count; i++) {
+                const auto status = APollQuery->Results(i)->ExecStatus();
+                if (status == PGRES_FATAL_ERROR || status == PGRES_BAD_RESPONSE)
+                    return false;
+            }
+
+            return true;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CServerProcess::RetrySQL(const CString &ConfName, CSQLQueue::CItems &Items) {
+            // The batch ran as one implicit transaction and was rolled back as a whole:
+            // every statement goes again on its own, so each caller gets its own outcome
+            for (auto &Item : Items) {
+                if (Item.Bound && Item.Binding == nullptr)
+                    continue;
+
+                CSQLQueue::CItems Single;
+                Single.push_back(std::move(Item));
+                SendSQL(ConfName, std::move(Single));
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CServerProcess::DoSQLQueueExecuted(CPQPollQuery *APollQuery, CSQLQueue::CItems &Items) {
+            for (size_t i = 0; i < Items.size(); i++) {
+                auto &Item = Items[i];
+
+                // The client went away while the statement was in flight
+                if (Item.Bound && Item.Binding == nullptr)
+                    continue;
+
+                try {
+                    Item.OnExecuted(Item.Binding, APollQuery->Results((int) i));
+                } catch (Delphi::Exception::Exception &E) {
+                    if (Item.OnException != nullptr) {
+                        Item.OnException(Item.Binding, E);
+                    } else {
+                        Log()->Error(APP_LOG_ERR, 0, "%s", E.what());
+                    }
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CServerProcess::DoSQLQueueException(CSQLQueue::CItems &Items, const Delphi::Exception::Exception &E) {
+            for (auto &Item : Items) {
+                if (Item.Bound && Item.Binding == nullptr)
+                    continue;
+
+                if (Item.OnException != nullptr) {
+                    Item.OnException(Item.Binding, E);
+                } else {
+                    Log()->Error(APP_LOG_ERR, 0, "%s", E.what());
+                }
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        void CServerProcess::ListenChannel(const CString &Channel, const CString &ConfName) {
+            if (!QueryCache().Subscribe(ConfName, Channel))
+                return;
+
+            std::string Quoted;
+            for (LPCSTR p = Channel.c_str(); *p != '\0'; p++) {
+                if (*p == '"')
+                    Quoted += '"';
+                Quoted += *p;
+            }
+
+            CStringList SQL;
+            SQL.Add(CString().Format("LISTEN \"%s\"", Quoted.c_str()));
+
+            // The channel counts as covered only once the LISTEN has succeeded; a failure allows a retry
+            auto OnExecuted = [ConfName, Channel](CPQPollQuery *APollQuery) {
+                if (APollQuery->ResultCount() > 0 && APollQuery->Results(0)->ExecStatus() == PGRES_COMMAND_OK) {
+                    QueryCache().Subscribed(ConfName, Channel, APollQuery->Connection());
+                } else {
+                    QueryCache().Unsubscribed(ConfName, Channel);
+                    Log()->Error(APP_LOG_ERR, 0, "LISTEN \"%s\" failed.", Channel.c_str());
+                }
+            };
+
+            auto OnException = [ConfName, Channel](CPQPollQuery *APollQuery, const Delphi::Exception::Exception &E) {
+                QueryCache().Unsubscribed(ConfName, Channel);
+                Log()->Error(APP_LOG_ERR, 0, "LISTEN \"%s\": %s", Channel.c_str(), E.what());
+            };
+
+            try {
+                ExecSQL(SQL, nullptr, OnExecuted, OnException,
+                        (ConfName.IsEmpty() ? m_ConfName : ConfName) + APOSTOL_PQ_LISTENER_SUFFIX);
+            } catch (Delphi::Exception::Exception &E) {
+                QueryCache().Unsubscribed(ConfName, Channel);
+                Log()->Error(APP_LOG_ERR, 0, "LISTEN \"%s\": %s", Channel.c_str(), E.what());
+            }
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
+        CQueryCache &CServerProcess::QueryCache() {
+            static CQueryCache QueryCache;
+            return QueryCache;
+        }
+        //--------------------------------------------------------------------------------------------------------------
+
         void CServerProcess::DoPQNotify(CPQConnection *AConnection, PGnotify *ANotify) {
+            QueryCache().Invalidate(ANotify->relname);
+
             const auto& conInfo = AConnection->ConnInfo();
             if (conInfo.ConnInfo().IsEmpty()) {
                 Log()->Postgres(APP_LOG_NOTICE, _T("ASYNC NOTIFY of '%s' received from backend PID %d"), ANotify->relname, ANotify->be_pid);
@@ -528,6 +1534,8 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         void CServerProcess::DoPQSendQuery(CPQQuery *AQuery) {
+            m_Queries += AQuery->SQL().Count();
+
             const auto pConnection = AQuery->Connection();
 
             if (pConnection == nullptr)
@@ -564,6 +1572,12 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         void CServerProcess::DoPQResult(CPQResult *AResult, ExecStatusType AExecStatus) {
+            CCachedTime::Update();
+
+            // One result per statement sent
+            if (m_Queries > 0)
+                m_Queries--;
+
             const auto pConnection = AResult->Query()->Connection();
 
             if (pConnection == nullptr)
@@ -620,6 +1634,9 @@ namespace Apostol {
         void CServerProcess::DoPQDisconnect(CObject *Sender) {
             const auto pConnection = dynamic_cast<CPQConnection *>(Sender);
             if (pConnection != nullptr) {
+                // Only the LISTEN connection matters to the cache: routine pool disconnects are ignored there
+                QueryCache().Disconnected(pConnection);
+
                 const auto& conInfo = pConnection->ConnInfo();
                 if (!conInfo.ConnInfo().IsEmpty()) {
                     Log()->Postgres(APP_LOG_NOTICE, "[%d] [%d] [postgresql://%s@%s:%s/%s] Disconnected.",
@@ -663,8 +1680,12 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         void CServerProcess::DoServerConnected(CObject *Sender) {
+            CCachedTime::Update();
+
             const auto pConnection = dynamic_cast<CTCPServerConnection *>(Sender);
             if (pConnection != nullptr) {
+                m_Connections++;
+
                 const auto pSocket = pConnection->Socket();
                 if (pSocket != nullptr) {
                     const auto pHandle = pSocket->Binding();
@@ -681,6 +1702,12 @@ namespace Apostol {
         void CServerProcess::DoServerDisconnected(CObject *Sender) {
             const auto pConnection = dynamic_cast<CTCPServerConnection *>(Sender);
             if (pConnection != nullptr) {
+                if (m_Connections > 0)
+                    m_Connections--;
+#ifdef WITH_POSTGRESQL
+                m_SQLQueue.Unbind(pConnection);
+#endif
+
                 const auto pSocket = pConnection->Socket();
                 if (pSocket != nullptr) {
                     const auto pHandle = pSocket->Binding();
@@ -727,6 +1754,8 @@ namespace Apostol {
         //--------------------------------------------------------------------------------------------------------------
 
         void CServerProcess::DoAccessLog(CTCPConnection *AConnection) {
+            m_Requests++;
+
             const auto pConnection = dynamic_cast<CHTTPServerConnection *> (AConnection);
 
             if (pConnection == nullptr)
@@ -738,12 +1767,18 @@ namespace Apostol {
             if (caRequest.Method.IsEmpty() || caRequest.URI.IsEmpty())
                 return;
 
-            TCHAR szTime[PATH_MAX / 4] = {0};
+            const auto duration = (Now() - AConnection->Clock()) * MSecsPerDay;
+
+            // Errors and slow requests are always logged, one of every "sample" of the rest
+            const auto sample = Config()->AccessSample();
+            const auto rate = (caReply.Status >= 400 || duration >= Config()->AccessSlow()) ? 1 : sample;
+
+            if (rate > 1 && m_AccessCounter++ % rate != 0)
+                return;
 
-            const time_t wtime = time(nullptr);
-            const tm *wtm = localtime(&wtime);
+            const auto szTime = CCachedTime::AccessTime();
 
-            if (wtm != nullptr && strftime(szTime, sizeof(szTime), "%d/%b/%Y:%T %z", wtm) != 0) {
+            if (*szTime != '\0') {
 
                 const auto& referer = caRequest.Headers[_T("Referer")];
                 const auto& user_agent = caRequest.Headers[_T("User-Agent")];
@@ -752,14 +1787,27 @@ namespace Apostol {
                 if (pSocket != nullptr) {
                     const auto pHandle = pSocket->Binding();
                     if (pHandle != nullptr) {
-                        Log()->Access(_T("%s %d %.3f [%s] \"%s %s HTTP/%d.%d\" %d %d \"%s\" \"%s\"\r\n"),
-                                      pHandle->PeerIP(), pHandle->PeerPort(),
-                                      (Now() - AConnection->Clock()) * MSecsPerDay / MSecsPerSec, szTime,
-                                      caRequest.Method.c_str(), caRequest.URI.c_str(),
-                                      caRequest.VMajor, caRequest.VMinor,
-                                      caReply.Status, caReply.Content.Size(),
-                                      referer.IsEmpty() ? "-" : referer.c_str(),
-                                      user_agent.IsEmpty() ? "-" : user_agent.c_str());
+                        if (sample > 1) {
+                            // The trailing field is the sample rate the line stands for
+                            Log()->Access(_T("%s %d %.3f [%s] \"%s %s HTTP/%d.%d\" %d %d \"%s\" \"%s\" %u\r\n"),
+                                          pHandle->PeerIP(), pHandle->PeerPort(),
+                                          duration / MSecsPerSec, szTime,
+                                          caRequest.Method.c_str(), caRequest.URI.c_str(),
+                                          caRequest.VMajor, caRequest.VMinor,
+                                          caReply.Status, caReply.Content.Size(),
+                                          referer.IsEmpty() ? "-" : referer.c_str(),
+                                          user_agent.IsEmpty() ? "-" : user_agent.c_str(),
+                                          rate);
+                        } else {
+                            Log()->Access(_T("%s %d %.3f [%s] \"%s %s HTTP/%d.%d\" %d %d \"%s\" \"%s\"\r\n"),
+                                          pHandle->PeerIP(), pHandle->PeerPort(),
+                                          duration / MSecsPerSec, szTime,
+                                          caRequest.Method.c_str(), caRequest.URI.c_str(),
+                                          caRequest.VMajor, caRequest.VMinor,
+                                          caReply.Status, caReply.Content.Size(),
+                                          referer.IsEmpty() ? "-" : referer.c_str(),
+                                          user_agent.IsEmpty() ? "-" : user_agent.c_str());
+                        }
                     }
                 }
             }
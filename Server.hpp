@@ -33,6 +33,302 @@ namespace Apostol {
 
         //--------------------------------------------------------------------------------------------------------------
 
+        //-- CScoreboard -----------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Per-process load figures in shared memory, mapped by the master before fork().
+        /// Every process writes only its own slot, on each event loop cycle.
+        class CScoreboard {
+        private:
+
+            struct alignas(64) CSlot {
+                std::atomic<pid_t> Pid;
+                char Name[20];
+                time_t Started;
+                std::atomic<time_t> Updated;
+                std::atomic<uint64_t> Loops;
+                std::atomic<uint64_t> Requests;
+                std::atomic<uint32_t> Rate;
+                std::atomic<uint32_t> Connections;
+                std::atomic<uint32_t> Queries;
+            };
+
+            CSlot *m_pSlots;
+            int m_Count;
+
+            CSlot *m_pSlot;
+
+            uint64_t m_Mark;
+            time_t m_MarkTime;
+
+        public:
+
+            CScoreboard();
+
+            ~CScoreboard();
+
+            void Create(int Count);
+            void Destroy();
+
+            bool Attach(LPCTSTR AName);
+
+            void Update(uint64_t Requests, uint32_t Connections, uint32_t Queries);
+
+            void Render(CString &Text) const;
+            void Dump() const;
+
+            bool Active() const { return m_pSlots != nullptr; }
+            bool Attached() const { return m_pSlot != nullptr; }
+
+        };
+#ifdef WITH_POSTGRESQL
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CSQLParam -------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        #define APOSTOL_SQL_PARAMS_MAX 65535
+        #define APOSTOL_PQ_LISTENER_SUFFIX "/listen"
+        //--------------------------------------------------------------------------------------------------------------
+
+        struct CSQLParam {
+            CString Value;
+            CString Type;
+            bool Binary;
+            bool Null;
+
+            CSQLParam(): Binary(false), Null(true) {
+            }
+
+            CSQLParam(const CString &Value, const CString &Type = {}, bool Binary = false):
+                Value(Value), Type(Type), Binary(Binary), Null(false) {
+            }
+
+            static CSQLParam Text(const CString &Value, const CString &Type = {}) { return {Value, Type}; }
+            static CSQLParam Bytea(const CString &Value) { return {Value, _T("bytea"), true}; }
+            static CSQLParam Nil(const CString &Type = {}) { CSQLParam Param; Param.Type = Type; return Param; }
+        };
+
+        typedef std::vector<CSQLParam> CSQLParams;
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CSQLBinder ------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Splices $N parameters into a statement as escaped literals. This spares modules the escaping only:
+        /// it is not a prepared statement, Postgres still parses and plans every call.
+        /// The escaping is unsafe where a multibyte character may contain a quote or backslash byte (SJIS, BIG5,
+        /// GBK, GB18030, UHC, JOHAB): Bind() refuses such a client_encoding. Server encodings never are one of
+        /// them, so a connection without client_encoding in its conninfo or PGCLIENTENCODING is safe; one set
+        /// by ALTER ROLE ... SET is not seen here and must not be used with bound parameters.
+        class CSQLBinder {
+        public:
+
+            struct CFragment {
+                size_t Offset;
+                size_t Length;
+                int Param;
+            };
+
+            struct CScan {
+                int Params;
+                /// Top-level statements, empty ones not counted
+                int Statements;
+                /// Leading keywords of the first statement, upper case
+                std::vector<std::string> Words;
+                /// The first statement has a top-level INTO
+                bool Into;
+                std::vector<CFragment> Fragments;
+            };
+
+            static void Scan(const CString &SQL, CScan &Result);
+
+            static bool IsReadOnly(const CScan &Scan);
+            static bool IsTransactional(const CScan &Scan);
+
+            static bool SafeEncoding(const CString &Encoding);
+
+            /// Encoding - client_encoding of the connection the statement goes to, empty - the server default
+            static void Bind(const CString &SQL, const CSQLParams &Params, CString &Result, const CString &Encoding = {});
+
+        };
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CSQLBatch -------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Statements sent to the server in a single simple-query message: one flush, one round trip.
+        /// Results come back in order, Results(i) belongs to the statement returned by Add().
+        /// Postgres runs the message as one implicit transaction: when a statement fails, the statements
+        /// before it are rolled back as well and the ones after it never run. Commands that cannot run inside
+        /// a transaction block (VACUUM, CREATE INDEX CONCURRENTLY, ...) and transaction control are refused.
+        class CSQLBatch {
+        private:
+
+            CStringList m_SQL;
+
+            bool m_Transactional = true;
+            /// Some entry has bound parameters: the connection encoding is checked on ExecSQL()
+            bool m_Bound = false;
+
+        public:
+
+            CSQLBatch() = default;
+
+            int Add(const CString &Statement);
+            int Add(const CString &Statement, const CSQLParams &Params);
+
+            void Clear() { m_SQL.Clear(); m_Transactional = true; m_Bound = false; }
+
+            void Pack(CStringList &SQL) const;
+
+            int Count() const { return m_SQL.Count(); }
+            bool Bound() const { return m_Bound; }
+
+            const CStringList &SQL() const { return m_SQL; }
+
+        };
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CQueryCache -----------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Serialized replies of read-only queries keyed by (ConfName, SQL) with a TTL and a memory budget.
+        /// Entries tagged with channels are dropped when a matching NOTIFY arrives.
+        class CQueryCache {
+        private:
+
+            struct CEntry {
+                size_t Hash;
+                CString ConfName;
+                CString SQL;
+                CString Content;
+                CStringList Channels;
+                time_t Expires;
+                size_t Size;
+            };
+
+            typedef std::list<CEntry> CEntryList;
+
+            CEntryList m_List;
+            std::unordered_map<size_t, CEntryList::iterator> m_Index;
+
+            /// LISTEN state per (ConfName, channel): false while the LISTEN is in flight, true once it succeeded
+            std::unordered_map<std::string, bool> m_Channels;
+
+            /// The dedicated connection the LISTENs of each configuration run on
+            std::unordered_map<std::string, CPQConnection *> m_Listeners;
+
+            /// Bumped on every invalidation: a reply read before it must not be stored after it
+            uint64_t m_Version;
+
+            size_t m_Size;
+
+            uint64_t m_Hits;
+            uint64_t m_Misses;
+            uint64_t m_Evictions;
+            uint64_t m_Invalidations;
+
+            static size_t Hash(const CString &ConfName, const CString &SQL);
+            static std::string ChannelKey(const CString &ConfName, const CString &Channel);
+
+            void Delete(CEntryList::iterator It);
+
+        public:
+
+            CQueryCache();
+
+            const CString *Find(const CString &ConfName, const CString &SQL);
+
+            void Add(const CString &ConfName, const CString &SQL, const CString &Content, u_int TTL,
+                const CStringList &Channels, uint64_t Version);
+
+            bool Subscribe(const CString &ConfName, const CString &Channel);
+            void Subscribed(const CString &ConfName, const CString &Channel, CPQConnection *AConnection);
+            void Unsubscribed(const CString &ConfName, const CString &Channel);
+
+            bool Confirmed(const CString &ConfName, const CStringList &Channels) const;
+
+            void Invalidate(LPCSTR Channel);
+            void Disconnected(CPQConnection *AConnection);
+
+            void Clear();
+
+            size_t Count() const { return m_List.size(); }
+            size_t Size() const { return m_Size; }
+
+            uint64_t Version() const { return m_Version; }
+
+            uint64_t Hits() const { return m_Hits; }
+            uint64_t Misses() const { return m_Misses; }
+            uint64_t Evictions() const { return m_Evictions; }
+            uint64_t Invalidations() const { return m_Invalidations; }
+
+        };
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        //-- CSQLQueue -------------------------------------------------------------------------------------------------
+
+        //--------------------------------------------------------------------------------------------------------------
+
+        typedef std::function<void (CPollConnection *AConnection, CPQResult *AResult)> COnSQLQueueExecutedEvent;
+        typedef std::function<void (CPollConnection *AConnection, const Delphi::Exception::Exception &E)> COnSQLQueueExceptionEvent;
+        //--------------------------------------------------------------------------------------------------------------
+
+        /// Single statements their callers declared read-only, queued during one event loop cycle, flushed per
+        /// configuration as CSQLBatch queries and demultiplexed back to their callbacks by result index. A batch
+        /// that fails is rolled back as a whole, so its statements are sent again one by one.
+        class CSQLQueue {
+        public:
+
+            struct CItem {
+                CString SQL;
+                CPollConnection *Binding;
+                bool Bound;
+                COnSQLQueueExecutedEvent OnExecuted;
+                COnSQLQueueExceptionEvent OnException;
+            };
+
+            typedef std::vector<CItem> CItems;
+
+            struct CGroup {
+                CString ConfName;
+                CItems Items;
+            };
+
+            typedef std::list<CItems> CRunning;
+
+        private:
+
+            std::vector<CGroup> m_Pending;
+            CRunning m_Running;
+
+        public:
+
+            CSQLQueue() = default;
+
+            void Add(const CString &ConfName, CItem &&Item);
+
+            void Unbind(CPollConnection *AConnection);
+
+            bool Empty() const { return m_Pending.empty(); }
+
+            std::vector<CGroup> &Pending() { return m_Pending; }
+            CRunning &Running() { return m_Running; }
+
+        };
+#endif
+        //--------------------------------------------------------------------------------------------------------------
+
         //-- CServerProcess --------------------------------------------------------------------------------------------
 
         //--------------------------------------------------------------------------------------------------------------
@@ -57,7 +353,23 @@ namespace Apostol {
 #ifdef WITH_POSTGRESQL
             CString m_ConfName;
             CPQClientList m_PQClients;
+
+            CSQLQueue m_SQLQueue;
+
+            void SendSQL(const CString &ConfName, CSQLQueue::CItems &&Items);
+            void RetrySQL(const CString &ConfName, CSQLQueue::CItems &Items);
+
+            static bool CheckSQLBatch(CPQPollQuery *APollQuery, int Count);
+
+            void DoSQLQueueExecuted(CPQPollQuery *APollQuery, CSQLQueue::CItems &Items);
+            static void DoSQLQueueException(CSQLQueue::CItems &Items, const Delphi::Exception::Exception &E);
 #endif
+            u_int m_AccessCounter;
+
+            uint64_t m_Requests;
+            uint32_t m_Connections;
+            uint32_t m_Queries;
+
             virtual void UpdateTimer();
 
         protected:
@@ -72,6 +384,8 @@ namespace Apostol {
 
             void InitializeServerHandlers();
 
+            static void SetReusePort(CSocketHandles *ABindings, int ASocketType, int AProtocol);
+
             void InitializeServer(const CString &Title, const CString &Listen = Config()->Listen(), u_short Port = Config()->Port());
 #ifdef WITH_POSTGRESQL
             void InitializePQClients(const CString &Title, u_int Min = Config()->PostgresPollMin(), u_int Max = Config()->PostgresPollMax());
@@ -163,6 +477,10 @@ namespace Apostol {
             void ServerStop();
             void ServerShutDown();
 
+            static CScoreboard &Scoreboard();
+
+            void UpdateScoreboard() const;
+
             virtual void Reload();
 
             const CPollEventHandlers &EventHandlers() const { return m_EventHandlers; }
@@ -203,6 +521,8 @@ namespace Apostol {
             CPQClient &GetPQClient(const CString& ConfName);
             const CPQClient &GetPQClient(const CString& ConfName) const;
 
+            CString ClientEncoding(const CString &ConfName) const;
+
             CPQClientList &PQClients() { return m_PQClients; };
             const CPQClientList &PQClients() const { return m_PQClients; };
 
@@ -212,6 +532,29 @@ namespace Apostol {
                          COnPQPollQueryExecutedEvent && OnExecuted = nullptr,
                          COnPQPollQueryExceptionEvent && OnException = nullptr,
                          const CString &ConfName = {});
+
+            CPQPollQuery *ExecSQL(const CString &Statement, const CSQLParams &Params, CPollConnection *AConnection = nullptr,
+                         COnPQPollQueryExecutedEvent && OnExecuted = nullptr,
+                         COnPQPollQueryExceptionEvent && OnException = nullptr,
+                         const CString &ConfName = {});
+
+            CPQPollQuery *ExecSQL(const CSQLBatch &Batch, CPollConnection *AConnection = nullptr,
+                         COnPQPollQueryExecutedEvent && OnExecuted = nullptr,
+                         COnPQPollQueryExceptionEvent && OnException = nullptr,
+                         const CString &ConfName = {});
+
+            /// ReadOnly - the caller guarantees the statement has no side effects (a SELECT may call a function that
+            /// writes): only such statements share a batch with other clients, any other one is sent on its own
+            void QueueSQL(const CString &SQL, CPollConnection *AConnection,
+                         COnSQLQueueExecutedEvent && OnExecuted,
+                         COnSQLQueueExceptionEvent && OnException = nullptr,
+                         const CString &ConfName = {}, bool ReadOnly = false);
+
+            void FlushSQL();
+
+            void ListenChannel(const CString &Channel, const CString &ConfName = {});
+
+            static CQueryCache &QueryCache();
 #endif
         };
     }